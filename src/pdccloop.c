@@ -40,6 +40,7 @@ PUBLIC bool
 process_comal_line(struct comal_line *line)
 {
     bool            result = false;
+    long            calldepth;
 
     if (!line)
         return false;
@@ -49,6 +50,12 @@ process_comal_line(struct comal_line *line)
             prog_addline(line);
             mem_shiftmem(PARSE_POOL, curenv->program_pool);
         } else if (line->cmd != 0) {
+            /*
+             * An error in a call from a direct command does not return
+             * through exec_call(), which would lower the depth again
+             */
+            calldepth = curenv->calldepth;
+
             if (setjmp(ERRBUF) == 0)
                 if (!cmd_exec(line, &result)) {
                     if (!curenv->curenv)
@@ -57,6 +64,7 @@ process_comal_line(struct comal_line *line)
                     exec_line(line);
                 }
 
+            curenv->calldepth = calldepth;
             give_run_err(NULL);
         }
     }
@@ -147,6 +155,13 @@ pdc_go(int argc __my_unused, char *argv[]__my_unused)
 
     DBG_PRINTF(true, "Interpreter restart code: %d", restart_err);
 
+    /*
+     * No calls are left, and no ENTER either, but the lines that ENTER
+     * had read are kept
+     */
+    curenv->calldepth = 0;
+    prog_splice();
+
     if (restart_err == PROG_END)
         clean_runenv(curenv);
 
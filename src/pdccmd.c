@@ -38,7 +38,7 @@ cmd_list_horse(struct string *filename, long from, long to)
     char            buf[MAX_LINELEN];
     char           *buf2;
     FILE           *listfile;
-    struct comal_line *work = curenv->progroot;
+    struct comal_line *work = prog_find_line(from);
 
     if (filename) {
         listfile = fopen(filename->s, "wt");
@@ -52,9 +52,6 @@ cmd_list_horse(struct string *filename, long from, long to)
         sys_setpaged(1);
     }
 
-    while (work && work->ld->lineno < from)
-        work = work->ld->next;
-
     while (work && work->ld->lineno <= to) {
         if (sys_escape()) {
             my_printf(MSG_DIALOG, true, "%s",
@@ -126,26 +123,24 @@ cmd_list(struct comal_line *line)
 }
 
 
-PRIVATE bool
-cmd_enter(struct comal_line *line)
+/*
+ * Read the lines of an ENTER file. Program lines are staged, other
+ * lines are run as commands, which take over ERRBUF; it is set back to
+ * enter_err afterwards.
+ */
+PRIVATE void
+enter_lines(FILE *yyenter, jmp_buf enter_err)
 {
-    FILE           *yyenter;
     char            tline[MAX_LINELEN];
     int             stoppen = 0;
     struct comal_line *aline;
 
-    yyenter = fopen(line->lc.str->s, "rt");
-
-    if (!yyenter)
-        run_error(OPEN_ERR, "File open error: %s", strerror(errno));
-
-    setvbuf(yyenter, NULL, _IOFBF, TEXT_BUFSIZE);
-    ++entering;
-
     while (!stoppen) {
         stoppen = (fgets(tline, MAX_LINELEN - 1, yyenter) == NULL);
 
         if (stoppen) {
+            prog_splice();
+
             if (!feof(yyenter))
                 run_error(CMD_ERR,
                           "Error when reading ENTER file: %s",
@@ -157,11 +152,49 @@ cmd_enter(struct comal_line *line)
                 my_nl(MSG_DIALOG);
                 my_printf(MSG_DIALOG, true, "Ignored line: %s", tline);
                 mem_freepool(PARSE_POOL);
-            } else
+            } else if (aline->ld && aline->cmd >= 0)
+                prog_stageline(aline);
+            else {
+                prog_splice();
                 process_comal_line(aline);
+                memcpy(ERRBUF, enter_err, sizeof(jmp_buf));
+            }
         }
     }
+}
+
+
+PRIVATE bool
+cmd_enter(struct comal_line *line)
+{
+    FILE           *yyenter;
+    jmp_buf         save_err;
+    jmp_buf         enter_err;
+
+    yyenter = fopen(line->lc.str->s, "rt");
 
+    if (!yyenter)
+        run_error(OPEN_ERR, "File open error: %s", strerror(errno));
+
+    setvbuf(yyenter, NULL, _IOFBF, TEXT_BUFSIZE);
+    ++entering;
+    memcpy(save_err, ERRBUF, sizeof(jmp_buf));
+
+    if (setjmp(ERRBUF) != 0) {
+        /*
+         * Keep the lines read before the error, as if they had been
+         * added one by one, and pass the error on
+         */
+        memcpy(ERRBUF, save_err, sizeof(jmp_buf));
+        fclose(yyenter);
+        --entering;
+        prog_splice();
+        longjmp(ERRBUF, 666);
+    }
+
+    memcpy(enter_err, ERRBUF, sizeof(jmp_buf));
+    enter_lines(yyenter, enter_err);
+    memcpy(ERRBUF, save_err, sizeof(jmp_buf));
     fclose(yyenter);
     --entering;
     prog_structure_scan();
@@ -228,7 +261,7 @@ cmd_load(struct comal_line *line)
         }
 
         fn = my_strdup(MISC_POOL, fn);
-        prog_load(fn);
+        prog_load(fn, NULL);
         curenv->name = fn;
         prog_structure_scan();
         mem_freepool(PARSE_POOL);
@@ -307,8 +340,7 @@ cmd_del(struct comal_line *line)
     if (from == 0 && to == INT_MAX)
         run_error(CMD_ERR, "Please mention a line number range with DEL");
 
-    if (prog_del(&curenv->progroot, from, to, 1))
-        prog_structure_scan();
+    prog_del(&curenv->progroot, from, to, 1);
     return false;
 }
 
@@ -23,6 +23,22 @@
 #define DEFAULT_DIMBOTTOM	(1)
 #define SQASH_BUFSIZE		(32767) /**< For save/load buffer */
 #define TEXT_BUFSIZE		(32767) /**< For list/enter buffer */
+#define FLOATUSING_MAX		(32)    /**< For a PRINT USING number format */
+#define USING_BUFSIZE		(4 * MAX_LINELEN)       /**< For PRINT USING output */
+#define RECORD_BUFSIZE		(32768) /**< For READ/WRITE FILE buffer */
+#define MAP_MINSIZE		(65536) /**< Initial mapping of a RANDOM file */
+#define INPUT_BUFSIZE		(262144)        /**< For INPUT FILE/SELECT INPUT */
+#define OUTPUT_BUFSIZE		(262144)        /**< For PRINT FILE/SELECT OUTPUT */
+#define FILE_TABLE_MIN		(64)    /**< Initial size of the open file table */
+#define FILE_TABLE_MAX		(65536) /**< File numbers kept in the table */
 #define OCOMAL_PATH_MAX		(256)   /**< Because pgcc can't find PATH_MAX */
+#define MAX_CALL_DEPTH		(4000)  /**< Default max nesting of PROC/FUNC calls */
+#define PUT_FLUSH_MSEC		(40)    /**< Max delay of batched screen output */
+#define HEADLESS_BUFSIZE	(65536) /**< stdin/stdout buffers without curses */
+#define LINE_INDEX_LEVELS	(12)    /**< Levels of the program line index */
+#define LEXEME_HASHSIZE		(512)   /**< Slots of the keyword hash table, a power of 2 */
+#define ID_HASHSIZE		(256)   /**< Initial slots of the identifier hash table, a power of 2 */
+#define SEG_CACHE_SIZE		(1048576)       /**< Max file size of the cached dynamic EXTERNAL segments */
+#define MAX_EXACT_INT		(9007199254740992.0)    /**< 2^53, largest int a double holds exactly */
 
 #endif
@@ -19,6 +19,7 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <sys/types.h>
 
 /** Base class for anything that is a member of a list */
 struct my_list {
@@ -74,11 +75,10 @@ enum VAL_TYPE { V_ERROR, V_INT, V_FLOAT, V_STRING, V_ARRAY };
 
 /**
  * Information about one identifier.
- * These are held in a tree data structure.
+ * These are held in a hash table.
  */
 struct id_rec {
-    struct id_rec  *left;
-    struct id_rec  *right;
+    struct id_rec  *next;       /**< Next identifier in the same hash chain */
     enum VAL_TYPE   type;
     char            name[1];
 };
@@ -186,7 +186,8 @@ struct exp_substr {
 
 enum optype { T_UNUSED, T_CONST, T_UNARY, T_BINARY, T_INTNUM, T_FLOAT,
     T_SUBSTR, T_STRING, T_ID, T_SID, T_SYS, T_SYSS,
-    T_EXP_IS_NUM, T_EXP_IS_STRING, T_ARRAY, T_SARRAY
+    T_EXP_IS_NUM, T_EXP_IS_STRING, T_ARRAY, T_SARRAY, T_FOLDED,
+    T_BINARY_I, T_BINARY_F
 };
 
 /**
@@ -211,6 +212,22 @@ struct dubbel {
     char           *text;
 };
 
+/**
+ * A constant subexpression, see exp_foldable().
+ *
+ * The original subexpression is kept for LIST and SAVE; its value is
+ * remembered the first time it is calculated.
+ */
+struct exp_folded {
+    struct expression *exp;
+    enum VAL_TYPE   type;       /**< V_ERROR until calculated */
+    union {
+        long            num;
+        double          fnum;
+        struct string  *str;
+    } val;
+};
+
 /** Storage for the different types of expression */
 union exp_data {
     long            num;
@@ -222,6 +239,7 @@ union exp_data {
     struct exp_sid  expsid;
     struct exp_substr expsubstr;
     struct exp_list *exproot;
+    struct exp_folded folded;
 };
 
 /** Metadata about an expression */
@@ -380,10 +398,24 @@ struct print_list {
  * Modifiers to the PRINT statement.
  * This implements either "AT" or "FILE".
  */
+/** One number field of a compiled PRINT USING picture */
+struct using_field {
+    char            fmt[FLOATUSING_MAX];        /**< Fmt format for the number */
+    char           *lit;        /**< Text after the field, or NULL */
+};
+
+/** A PRINT USING picture, compiled */
+struct using_fmt {
+    char           *lead;       /**< Text before the first field */
+    int             nrfields;
+    struct using_field field[];
+};
+
 struct print_modifier {
     int             type;
     struct two_exp *twoexp;
     struct expression *c_using;         /**< This can be "stacked" with "AT" or "FILE" */
+    struct using_fmt *using_fmt;        /**< Compiled constant c_using */
 };
 
 /** Parameters to the PRINT statement */
@@ -409,6 +441,34 @@ struct when_list {
     struct expression *exp;
 };
 
+/**
+ * Entry in the hash table of a CASE jump table
+ * @extends my_list
+ */
+struct case_entry {
+    struct case_entry *next;
+    long            key;
+    struct string  *skey;   /**< String key, owned by the WHEN line */
+    struct comal_line *whenline;
+};
+
+/** Jump table for a CASE whose WHENs are all constants, built by SCAN */
+struct case_table {
+    enum VAL_TYPE   type;   /**< V_INT or V_STRING keys */
+    bool            dense;
+    long            low;    /**< Key of slot[0] in a dense table */
+    long            size;   /**< Number of slots or buckets */
+    struct comal_line **slot;
+    struct case_entry **bucket;
+    struct comal_line *otherwise;
+};
+
+/** Arguments to a CASE statement */
+struct case_rec {
+    struct expression *exp;
+    struct case_table *table;
+};
+
 /** Arguments to a WRITE statement */
 struct write_rec {
     struct two_exp  twoexp;
@@ -420,6 +480,13 @@ struct trap_rec {
     int             esc;
 };
 
+/** Shortcuts exec_assign() can take for an assignment */
+enum assign_kind {
+    A_GENERAL,                  /**< No shortcut */
+    A_NUM,                      /**< x:=, x(i):= for numeric x */
+    A_INCR                      /**< x:+, x:- for simple numeric x */
+};
+
 /**
  * List of assignments
  * @extends my_list
@@ -429,6 +496,7 @@ struct assign_list {
     int             op;
     struct expression *lval;
     struct expression *exp;
+    enum assign_kind kind;      /**< Set by SCAN */
 };
 
 /**
@@ -464,6 +532,7 @@ union line_contents {
     struct trap_rec traprec;
     struct read_rec readrec;
     struct when_list *whenroot;
+    struct case_rec caserec;
     struct write_rec writerec;
     struct assign_list *assignroot;
 };
@@ -476,6 +545,17 @@ struct comal_line {
     union line_contents lc;
 };
 
+/** Read buffer of a text file read line by line */
+struct line_reader {
+    FILE           *fp;
+    char           *buf;
+    long            size;       /**< Size of buf, not counting the NUL */
+    long            start;      /**< First byte not yet handed out */
+    long            end;        /**< End of the data in buf */
+    bool            eof;        /**< fp has nothing more to give */
+    bool            bylines;    /**< Fill a line at a time (not a file) */
+};
+
 /**
  * An open file
  * @extends my_list
@@ -487,6 +567,22 @@ struct file_rec {
     int             mode;
     long            reclen;
     bool            read_only;
+    bool            mapped;     /**< RANDOM file accessed through map */
+    char           *map;        /**< Mapping of the file, or NULL */
+    long            mapsize;    /**< Size of the mapping */
+    long            size;       /**< Size of the file's contents */
+    long            pos;        /**< Read/write position in the map */
+    struct line_reader *reader; /**< Buffer of INPUT FILE, or NULL */
+    char           *outbuf;     /**< stdio buffer of output, or NULL */
+    char           *wbuf;       /**< Record of WRITE FILE being built, or NULL */
+    long            wlen;       /**< Bytes waiting in wbuf */
+};
+
+/** Node of the skip list that indexes the program lines by number */
+struct line_node {
+    struct comal_line *line;
+    int             height;     /**< Number of levels the node is on */
+    struct line_node *next[];
 };
 
 /** Descriptor for an external segment */
@@ -496,6 +592,19 @@ struct seg_des {
     struct comal_line *procdef;
     struct comal_line *lineroot;
     struct comal_line *save_localproc;
+    struct seg_des *next;       /**< Next in the cache of unused segments */
+    char           *filename;   /**< File of a dynamic segment, else NULL */
+    dev_t           dev;        /**< Device of that file */
+    ino_t           ino;        /**< Inode of that file */
+    long            mtime;      /**< Modification time of that file (s) */
+    long            mtime_nsec; /**< ... and its nanoseconds */
+    long            size;       /**< Size of that file */
+};
+
+/** Structure links read from an image by expand_fromfile() */
+struct sqash_links {
+    bool            linked;     /**< The file carried the links */
+    struct comal_line *globalproc;
 };
 
 /** Element of the exported function table */
@@ -526,17 +635,26 @@ struct comal_env {
     struct sym_env *rootenv;
     struct sym_env *curenv;
     struct comal_line *globalproc;
+    struct comal_line *dirtyproc;       /**< Routine holding all edits since the last SCAN */
 
     struct comal_line *progroot;
+    struct line_node *lineindex[LINE_INDEX_LEVELS];     /**< Index of progroot */
     struct seg_des *segroot;
+    struct seg_des *segcache;   /**< Unused dynamic segments, most recent first */
+    long            segcache_size;      /**< File size of all of segcache */
     struct comal_line *curline;
     struct comal_line *datalptr;
     struct exp_list *dataeptr;
-    struct file_rec *fileroot;
+    struct file_rec *fileroot;  /**< Open files outside files[] */
+    struct file_rec **files;    /**< Open files, by file number */
+    unsigned long  *fileused;   /**< Bitmap of the used files[] slots */
+    long            nrfiles;    /**< Size of files[] */
+    long            highfile;   /**< Highest file number in files[] */
     struct mem_pool *program_pool;
 
     int             running;
     int             nrtraps;
+    long            calldepth;
 
     char           *name;
     int             con_inhibited;
@@ -39,6 +39,12 @@ extern bool     sys_escape(void);
 /** Output a string to a stream */
 extern void     sys_put(int stream, const char *buf, long len);
 
+/** Show screen output that is still pending */
+extern void     sys_flush(void);
+
+/** Write screen output to stdout instead of using curses */
+extern void     sys_headless(void);
+
 /** Clear the screen */
 extern void     sys_page(FILE * f);
 
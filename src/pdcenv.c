@@ -23,6 +23,7 @@
 #include "pdcmod.h"
 #include "pdcsym.h"
 #include "pdcenv.h"
+#include "pdcexec.h"
 #include <string.h>
 #include <stdio.h>
 
@@ -33,9 +34,13 @@ env_new(const char *name)
     struct env_list *work2 = GETCORE(MISC_POOL, struct env_list);
 
     work->progroot = NULL;
+    memset(work->lineindex, 0, sizeof(work->lineindex));
     work->segroot = NULL;
+    work->segcache = NULL;
+    work->segcache_size = 0;
     work->envname = my_strdup(MISC_POOL, name);
     work->scan_ok = false;
+    work->dirtyproc = NULL;
     work->rootenv = NULL;
     work->curenv = NULL;
     work->changed = false;
@@ -50,11 +55,16 @@ env_new(const char *name)
     work->con_inhibited = false;
     work->running = 0;
     work->fileroot = NULL;
+    work->files = NULL;
+    work->fileused = NULL;
+    work->nrfiles = 0;
+    work->highfile = 0;
     work->lasterr = 0;
     work->lasterrmsg = NULL;
     work->errline = 0;
     work->escallowed = true;
     work->nrtraps = 0;
+    work->calldepth = 0;
     work->program_pool = pool_new();
 
     work2->next = env_root;
@@ -88,7 +98,6 @@ env_find(char *name)
 PUBLIC void
 clean_runenv(struct comal_env *env)
 {
-    struct file_rec *fwalk = curenv->fileroot;
     struct comal_line *walk;
 
     DBG_PRINTF(true, "Cleaning runenv");
@@ -111,6 +120,7 @@ clean_runenv(struct comal_env *env)
     env->errline = 0;
     env->escallowed = true;
     env->nrtraps = 0;
+    env->calldepth = 0;
     env->running = 0;
     env->curenv = NULL;
 
@@ -120,14 +130,7 @@ clean_runenv(struct comal_env *env)
     /*
      * Close all open files
      */
-    while (fwalk) {
-        DBG_PRINTF(true, "Closing comal file %D", fwalk->cfno);
-
-        fclose(fwalk->hfptr);
-        fwalk = fwalk->next;
-    }
-
-    curenv->fileroot = NULL;
+    file_closeall();
 
     mod_freeall();
     seg_allfree();
@@ -141,9 +144,11 @@ clear_env(struct comal_env *env)
     clean_runenv(env);
 
     env->progroot = NULL;
+    memset(env->lineindex, 0, sizeof(env->lineindex));
     env->rootenv = NULL;
     env->changed = false;
     env->scan_ok = false;
+    env->dirtyproc = NULL;
 
     mem_free(env->name);
 
@@ -70,5 +70,6 @@
 #define SPC_ERR		49      /**< Error in parameter to SPC$ */
 #define DIR_ERR		50      /**< Error in MKDIR, CHDIR of RMDIR */
 #define RND_ERR		51      /**< Error in the arguments for RND */
+#define DEPTH_ERR	52      /**< PROC/FUNC calls nested too deeply */
 
 #endif
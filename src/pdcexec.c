@@ -37,22 +37,30 @@
 #include <stdbool.h>
 #include <time.h>
 #include <ctype.h>
+#include <math.h>
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "fmt.h"
 
-#define FLOATUSING_MAX 32
+PUBLIC long     max_call_depth = MAX_CALL_DEPTH;
+PUBLIC long     using_compiles;
 
 PRIVATE void   *return_result;  /* For comms of FUNC results */
 PRIVATE enum VAL_TYPE return_type;
+PRIVATE struct sym_env *tail_env;       /* New frame of a tail call */
+PRIVATE char    rec_buf[RECORD_BUFSIZE];        /* For READ FILE */
 PRIVATE FILE   *prev_sel_file;
-PRIVATE bool    in_print_file,
-                in_input_file;
+PRIVATE bool    in_print_file;
+PRIVATE struct file_rec *input_frec;    /* File of INPUT FILE */
+PRIVATE struct line_reader sel_reader;  /* Buffer of SELECT INPUT */
+PRIVATE char    sel_outbuf[OUTPUT_BUFSIZE];     /* Buffer of SELECT OUTPUT */
 
 PRIVATE int     exec_seq3(void);
 PRIVATE int     exec_seq2(void);
 PRIVATE void    print_con(struct print_list *printroot, int pr_sep);
-PRIVATE void    print_using(struct expression *str,
+PRIVATE void    print_using(struct print_modifier *m,
                             struct print_list *printroot, int pr_sep);
 PRIVATE void    input_con(struct expression *len, struct string *prompt,
                           struct exp_list *lvalroot, int pr_sep);
@@ -93,11 +101,7 @@ run_error(int error, const char *s, ...)
 
     mem_free(curenv->errmsg);
     curenv->errmsg = buf;
-    if (in_input_file) {
-        sel_infile = prev_sel_file;
-        prev_sel_file = NULL;
-        in_input_file = false;
-    }
+    input_frec = NULL;
     if (in_print_file) {
         sel_outfile = prev_sel_file;
         prev_sel_file = NULL;
@@ -389,6 +393,48 @@ decode_parmlist(struct sym_env *env, struct parm_list *plist,
         run_error(PARM_ERR, "Too much parameters provided");
 }
 
+/*
+ * A RETURN or EXEC that the scanner found to call its own PROC/FUNC
+ * in tail position (line->lineptr points to the PROC/FUNC line) does
+ * not nest another exec_call(). Instead the new parameters are decoded
+ * into a fresh environment, and exec_call() swaps it in for the
+ * current one and restarts the routine body.
+ */
+PRIVATE bool
+exec_tailcall(struct comal_line *line, int calltype)
+{
+    struct sym_env *env = curenv->curenv;
+    struct comal_line *pfline = env->curproc;
+    struct expression *exp = line->lc.exp;
+    struct id_rec  *id;
+
+    if (line->lineptr != pfline)
+        return false;
+
+    if (exp->optype == T_EXP_IS_NUM || exp->optype == T_EXP_IS_STRING)
+        exp = exp->e.exp;
+
+    id = exp->e.expid.id;
+
+    /*
+     * A variable or NAME parameter shadows the FUNC, just like in
+     * exp_id() and exp_sid()
+     */
+    if (calltype == funcSYM && (sym_search(env, id, S_VAR)
+                                || sym_search(env, id, S_NAME)))
+        return false;
+
+    if (routine_search(id, calltype) != pfline)
+        return false;
+
+    tail_env = sym_newenv(pfline->lc.pfrec.closed, env->prev, NULL,
+                          pfline, id->name);
+    decode_parmlist(tail_env, pfline->lc.pfrec.parmroot,
+                    exp->e.expid.exproot);
+
+    return true;
+}
+
 /*
  * This function is way too complicated...
  */
@@ -407,6 +453,7 @@ exec_call(struct expression *exp, int calltype, void **result,
     struct comal_line *modline = NULL;
     struct sym_env *modenv = NULL;
     struct sym_env *aliasenv = NULL;
+    int             retcode;
 
     /*
      * If we are running in the command loop, first scan the program
@@ -421,6 +468,14 @@ exec_call(struct expression *exp, int calltype, void **result,
                       "Execution of direct command aborted due to program structure errors");
     }
 
+    /*
+     * Every nested call costs host stack, so stop before it runs out
+     */
+    if (curenv->calldepth >= max_call_depth)
+        run_error(DEPTH_ERR,
+                  "PROC/FUNC calls nested too deeply (max. %D)",
+                  max_call_depth);
+
     /*
      * Search the Comal line with the proc/func definition
      */
@@ -495,10 +550,21 @@ exec_call(struct expression *exp, int calltype, void **result,
     curenv->curline = pfline->ld->next;
     wasrunning = curenv->running;
     curenv->running = RUNNING;
+    curenv->calldepth++;
+
+    while ((retcode = exec_seq2()) == execSYM) {
+        IP(tail_env->prev == env->prev, "exec_call internal error #2");
+
+        sym_freeenv(env, 0);
+        env = tail_env;
+        curenv->curenv = env;
+        curenv->curline = pfline->ld->next;
+    }
 
-    if (exec_seq2() != returnSYM)
+    if (retcode != returnSYM)
         fatal("Internal CALL/RETURN error #1");
 
+    curenv->calldepth--;
     curenv->curline = curline;
     env = sym_freeenv(env, 0);
 
@@ -935,13 +1001,133 @@ do_assign1(struct expression *lval, int op, struct expression *rval)
 }
 
 
+/*
+ * x:=exp or x(i):=exp for a numeric x (A_NUM)
+ */
+PRIVATE void
+do_num_assign1(struct assign_list *work)
+{
+    void           *result;
+    enum VAL_TYPE   type;
+    void           *lvalptr;
+    struct var_item *lvar;
+    long            strl;
+    enum VAL_TYPE   ltype;
+
+    calc_exp(work->exp, &result, &type);
+
+    if (type != V_INT && type != V_FLOAT) {
+        do_assign2(work->lval, result, type, 1);
+        return;
+    }
+
+    lvalptr = exec_lval(work->lval, &ltype, &lvar, &strl);
+    do_num_assign(lvalptr, ltype, lvar, result, type, 1);
+}
+
+
+/*
+ * x:+exp or x:-exp for a simple numeric variable x (A_INCR), done in
+ * place. Returns false if x is not an existing variable (but a NAME
+ * parameter, say), for do_assign1() to sort out.
+ */
+PRIVATE bool
+do_incr(struct assign_list *work)
+{
+    void           *lvalptr;
+    struct var_item *lvar;
+    enum VAL_TYPE   ltype;
+    void           *result;
+    enum VAL_TYPE   type;
+    long            i1 = 0,
+                    i2 = 0,
+                    i3;
+    double          d1 = 0,
+                    d2 = 0;
+
+    lvalptr = exp_lval(work->lval, &ltype, &lvar, NULL);
+
+    if (!lvalptr || ltype == V_ARRAY)
+        return false;
+
+    /*
+     * Like in x:=x+exp, x is taken before exp is calculated 
+     */
+    if (ltype == V_INT)
+        i1 = *(long *) lvalptr;
+    else
+        d1 = *(double *) lvalptr;
+
+    calc_exp(work->exp, &result, &type);
+
+    if (type == V_INT)
+        i2 = *(long *) result;
+    else if (type == V_FLOAT)
+        d2 = *(double *) result;
+    else {
+        val_free(result, type);
+        run_error(TYPE_ERR,
+                  "Type mismatch in assignment (numeric expected)");
+    }
+
+    cell_free(result);
+
+    if (ltype == V_INT && type == V_INT) {
+        if (work->op == becminusSYM)
+            i2 = -i2;
+
+        i3 = (long) ((unsigned long) i1 + (unsigned long) i2);
+
+        /*
+         * On overflow x+exp becomes a float, see val_intadd() 
+         */
+        if ((i1 < 0) == (i2 < 0) && (i3 < 0) != (i1 < 0)) {
+            d1 = (double) i1 + (double) i2;
+            val_copy(lvalptr, &d1, V_INT, V_FLOAT);
+        } else
+            *(long *) lvalptr = i3;
+
+        return true;
+    }
+
+    if (ltype == V_INT)
+        d1 = i1;
+
+    if (type == V_INT)
+        d2 = i2;
+
+    if (work->op == becminusSYM)
+        d1 = d1 - d2;
+    else
+        d1 = d1 + d2;
+
+    val_copy(lvalptr, &d1, ltype, V_FLOAT);
+
+    return true;
+}
+
+
 PRIVATE void
 exec_assign(struct comal_line *line)
 {
     struct assign_list *work = line->lc.assignroot;
 
     while (work) {
-        do_assign1(work->lval, work->op, work->exp);
+        switch (work->kind) {
+        case A_NUM:
+            do_num_assign1(work);
+            break;
+
+        case A_INCR:
+            if (!do_incr(work))
+                do_assign1(work->lval, work->op, work->exp);
+
+            break;
+
+        default:
+            do_assign1(work->lval, work->op, work->exp);
+        }
+
         work = work->next;
     }
 }
@@ -1004,6 +1190,7 @@ exec_trap(struct comal_line *line)
     jmp_buf         save_err;
     static int      retcode;
     struct seg_des *seg_marker;
+    long            depth_marker;
 
     retcode = 0;
 
@@ -1015,6 +1202,7 @@ exec_trap(struct comal_line *line)
 
     memcpy(save_err, ERRBUF, sizeof(jmp_buf));
     seg_marker = curenv->segroot;
+    depth_marker = curenv->calldepth;
     curenv->nrtraps++;
 
   retry:
@@ -1036,6 +1224,8 @@ exec_trap(struct comal_line *line)
         while (curenv->segroot != seg_marker)
             seg_dynamic_free(curenv->segroot);
 
+        curenv->calldepth = depth_marker;
+
         if (line->lineptr->cmd == handlerSYM) {
             retcode = exec_seq3();
 
@@ -1243,6 +1433,74 @@ exec_for(struct comal_line *line)
 }
 
 
+/*
+ * Look up the selector of a CASE in its jump table. Returns false if
+ * the table can not decide, in which case the WHENs must be searched
+ * one by one and *whenline is left alone. Otherwise *whenline is the
+ * WHEN or OTHERWISE line to continue with, or NULL if there is none.
+ */
+PRIVATE bool
+case_lookup(struct case_table *table, void *cresult, enum VAL_TYPE ctype,
+            struct comal_line **whenline)
+{
+    struct case_entry *walk;
+    double          d;
+    long            key = 0;
+    long            i;
+
+    if (table->type == V_STRING) {
+        if (ctype != V_STRING)
+            return false;
+
+        *whenline = table->otherwise;
+        i = str_hash(((struct string *) cresult)->s) % table->size;
+
+        for (walk = table->bucket[i]; walk; walk = walk->next)
+            if (str_cmp(walk->skey, (struct string *) cresult) == 0) {
+                *whenline = walk->whenline;
+                break;
+            }
+
+        return true;
+    }
+
+    if (ctype != V_INT && ctype != V_FLOAT)
+        return false;
+
+    *whenline = table->otherwise;
+
+    if (ctype == V_INT)
+        key = *(long *) cresult;
+    else {
+        d = *(double *) cresult;
+
+        if (d != floor(d) || d > MAX_EXACT_INT || d < -MAX_EXACT_INT)
+            return true;
+
+        key = d;
+    }
+
+    if (table->dense) {
+        if (key >= table->low
+            && (unsigned long) key - (unsigned long) table->low <
+            (unsigned long) table->size && table->slot[key - table->low])
+            *whenline = table->slot[key - table->low];
+
+        return true;
+    }
+
+    i = (unsigned long) key % table->size;
+
+    for (walk = table->bucket[i]; walk; walk = walk->next)
+        if (walk->key == key) {
+            *whenline = walk->whenline;
+            break;
+        }
+
+    return true;
+}
+
+
 PRIVATE void
 exec_case(struct comal_line *line)
 {
@@ -1254,7 +1512,16 @@ exec_case(struct comal_line *line)
     struct when_list *walk;
     int             casefound = 0;
 
-    calc_exp(line->lc.exp, &cresult, &ctype);
+    calc_exp(line->lc.caserec.exp, &cresult, &ctype);
+
+    if (line->lc.caserec.table
+        && case_lookup(line->lc.caserec.table, cresult, ctype, &whenline)) {
+        if (whenline)
+            curenv->curline = whenline->ld->next;
+
+        val_free(cresult, ctype);
+        return;
+    }
 
     while (!casefound && whenline->cmd != endcaseSYM) {
         if (whenline->cmd == otherwiseSYM) {
@@ -1282,10 +1549,22 @@ exec_case(struct comal_line *line)
 }
 
 
+/*
+ * Open files are kept in curenv->files[], indexed by their file number,
+ * with a bitmap of the slots in use. The odd file numbers outside
+ * 0..FILE_TABLE_MAX-1 go on the curenv->fileroot list.
+ */
+#define FILE_WORDBITS	(CHAR_BIT * sizeof(unsigned long))
+
 PUBLIC struct file_rec *
 fsearch(long i)
 {
-    struct file_rec *walk = curenv->fileroot;
+    struct file_rec *walk;
+
+    if (i >= 0 && i < FILE_TABLE_MAX)
+        return i < curenv->nrfiles ? curenv->files[i] : NULL;
+
+    walk = curenv->fileroot;
 
     while (walk && walk->cfno != i)
         walk = walk->next;
@@ -1295,169 +1574,583 @@ fsearch(long i)
 
 
 PRIVATE void
-exec_open(struct comal_line *line)
+file_grow(long need)
 {
-    struct string  *name;
-    enum VAL_TYPE   type;
-    struct file_rec *frec;
-    struct open_rec *o = &line->lc.openrec;
-    const char     *flags;
-    char           *fname;
-
-    calc_exp(o->filename, (void **) &name, &type);
-    frec =
-        (struct file_rec *) mem_alloc(RUN_POOL, sizeof(struct file_rec));
-    frec->cfno = calc_intexp(o->filenum);
+    long            newsize = curenv->nrfiles * 2;
+    struct file_rec **files;
+    unsigned long  *used;
 
-    if (fsearch(frec->cfno))
-        run_error(OPEN_ERR, "File %D already open", frec->cfno);
+    if (newsize < FILE_TABLE_MIN)
+        newsize = FILE_TABLE_MIN;
 
-    frec->mode = o->type;
-    frec->read_only = false;
+    while (newsize < need)
+        newsize *= 2;
 
-    switch (frec->mode) {
-    case readSYM:
-        flags = "rb";
-        frec->read_only = true;
-        break;
+    if (newsize > FILE_TABLE_MAX)
+        newsize = FILE_TABLE_MAX;
 
-    case writeSYM:
-        flags = "wbx";
-        break;
+    files = mem_alloc(RUN_POOL, newsize * sizeof(struct file_rec *));
+    used =
+        mem_alloc(RUN_POOL,
+                  newsize / FILE_WORDBITS * sizeof(unsigned long));
 
-    case appendSYM:
-        flags = "ab";
-        break;
+    if (curenv->files) {
+        memcpy(files, curenv->files,
+               curenv->nrfiles * sizeof(struct file_rec *));
+        memcpy(used, curenv->fileused,
+               curenv->nrfiles / FILE_WORDBITS * sizeof(unsigned long));
+        mem_free(curenv->files);
+        mem_free(curenv->fileused);
+    }
 
-    case randomSYM:
-        frec->reclen = calc_intexp(o->reclen);
+    curenv->files = files;
+    curenv->fileused = used;
+    curenv->nrfiles = newsize;
+}
 
-        if (frec->reclen <= 0)
-            run_error(OPEN_ERR, "Invalid record length %D", frec->reclen);
 
-        if (o->read_only) {
-            flags = "rb";
-            frec->read_only = true;
-        } else {
-            flags = "rb+";
-        }
+PRIVATE void
+file_add(struct file_rec *f)
+{
+    long            i = f->cfno;
 
-        break;
+    if (i < 0 || i >= FILE_TABLE_MAX) {
+        f->next = curenv->fileroot;
+        curenv->fileroot = f;
 
-    default:
-        IP(false, "open filemode switch default action");
+        return;
     }
 
-    fname = str_ltou(name->s);
-    if (frec->mode == randomSYM && !o->read_only
-        && access(fname, F_OK) != 0) {
-        // The modern replacement for creat(2)
-        int             fd =
-            open(fname, O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR);
-        if (fd < 0) {
-            run_error(OPEN_ERR, "OPEN error: %s", strerror(errno));
-        }
-        close(fd);
-    }
-    frec->hfptr = fopen(fname, flags);
+    if (i >= curenv->nrfiles)
+        file_grow(i + 1);
 
-    if (frec->hfptr == NULL)
-        run_error(OPEN_ERR, "OPEN error: %s", strerror(errno));
+    curenv->files[i] = f;
+    curenv->fileused[i / FILE_WORDBITS] |= 1UL << (i % FILE_WORDBITS);
 
-    frec->next = curenv->fileroot;
-    curenv->fileroot = frec;
+    if (i > curenv->highfile)
+        curenv->highfile = i;
 }
 
 
 PRIVATE void
-exec_create(struct comal_line *line)
+file_remove(struct file_rec *f)
 {
-    struct create_rec *c = &line->lc.createrec;
-    struct string  *name;
-    enum VAL_TYPE   type;
-    char           *fname;
-    FILE           *f;
+    long            i = f->cfno;
+    long            w;
+    struct file_rec **walk;
 
-    calc_exp(c->filename, (void **) &name, &type);
-    fname = str_ltou(name->s);
-    f = fopen(fname, "wbx");
-    if (f == NULL) {
-        run_error(OPEN_ERR, "OPEN error: %s", strerror(errno));
-    }
-    fseek(f, calc_intexp(c->top) * calc_intexp(c->reclen) - 1, SEEK_SET);
-    fputc(0, f);
-    fclose(f);
-}
+    if (i < 0 || i >= FILE_TABLE_MAX) {
+        for (walk = &curenv->fileroot; *walk != f; walk = &(*walk)->next);
 
+        *walk = f->next;
 
-PRIVATE void
-exec_close(struct comal_line *line)
-{
-    struct exp_list *work = line->lc.exproot;
-    struct file_rec *walk;
+        return;
+    }
 
-    if (!work) {
-        walk = curenv->fileroot;
+    curenv->files[i] = NULL;
+    curenv->fileused[i / FILE_WORDBITS] &= ~(1UL << (i % FILE_WORDBITS));
 
-        while (walk) {
-            DBG_PRINTF(true, "Closing Comal file %D", walk->cfno);
+    if (i < curenv->highfile)
+        return;
 
-            if (fclose(walk->hfptr) == EOF)
-                run_error(CLOSE_ERR,
-                          "Close error on file %D: %s",
-                          walk->cfno, strerror(errno));
+    /*
+     * Find the new highest file number (for FREEFILE) 
+     */
+    curenv->highfile = 0;
 
-            walk = (struct file_rec *) mem_free(walk);
-        }
+    for (w = i / FILE_WORDBITS; w >= 0; w--)
+        if (curenv->fileused[w]) {
+            i = (w + 1) * FILE_WORDBITS - 1;
 
-        curenv->fileroot = NULL;
-    } else {
-        while (work) {
-            struct file_rec *last;
-            long            fno;
+            while (!curenv->files[i])
+                i--;
 
-            fno = calc_intexp(work->exp);
-            walk = curenv->fileroot;
-            last = NULL;
+            curenv->highfile = i;
+            break;
+        }
+}
 
-            while (walk && walk->cfno != fno) {
-                last = walk;
-                walk = walk->next;
-            }
 
-            if (!walk)
-                run_error(CLOSE_ERR, "File %D not open", fno);
+/*
+ * Return an open file, or NULL if there are none
+ */
+PRIVATE struct file_rec *
+file_first(void)
+{
+    long            w;
+    long            i;
 
-            if (fclose(walk->hfptr) == EOF)
-                run_error(CLOSE_ERR,
-                          "CLOSE error on file %D: %s",
-                          walk->cfno, strerror(errno));
-            else {
-                if (last)
-                    last->next = walk->next;
-                else
-                    curenv->fileroot = walk->next;
+    for (w = 0; w < curenv->nrfiles / (long) FILE_WORDBITS; w++)
+        if (curenv->fileused[w]) {
+            i = w * FILE_WORDBITS;
 
-                mem_free(walk);
-            }
+            while (!curenv->files[i])
+                i++;
 
-            work = work->next;
+            return curenv->files[i];
         }
-    }
+
+    return curenv->fileroot;
 }
 
 
-PRIVATE struct file_rec *
-pos_file(struct two_exp *r)
+PUBLIC void
+file_closeall(void)
 {
-    long            cfno = calc_intexp(r->exp1);
-    struct file_rec *f = fsearch(cfno);
+    struct file_rec *f;
 
-    if (!f)
-        run_error(POS_ERR, "File %D not open", cfno);
+    while ((f = file_first()) != NULL) {
+        DBG_PRINTF(true, "Closing comal file %D", f->cfno);
 
-    if (f->mode == randomSYM) {
-        long            recno;
+        file_remove(f);
+        file_close(f);
+    }
+
+    curenv->files = NULL;
+    curenv->fileused = NULL;
+    curenv->nrfiles = 0;
+    curenv->highfile = 0;
+}
+
+
+/*
+ * RANDOM files on regular files are mapped into memory, so that READ
+ * FILE and WRITE FILE access their records directly instead of through
+ * fseek/fread/fwrite. The mapping is grown in steps beyond the end of
+ * the file, but the file itself is only extended up to the end of each
+ * record as it is written; the part of the mapping past f->size is
+ * never touched.
+ */
+PRIVATE void
+map_open(struct file_rec *f)
+{
+    struct stat     st;
+    int             prot = PROT_READ;
+
+    f->mapped = false;
+    f->map = NULL;
+    f->mapsize = 0;
+    f->pos = 0;
+
+    if (fstat(fileno(f->hfptr), &st) < 0 || !S_ISREG(st.st_mode))
+        return;
+
+    f->size = st.st_size;
+
+    if (!f->read_only)
+        prot |= PROT_WRITE;
+
+    if (f->size > 0) {
+        f->map =
+            mmap(NULL, f->size, prot, MAP_SHARED, fileno(f->hfptr), 0);
+
+        if (f->map == MAP_FAILED) {
+            f->map = NULL;
+            return;
+        }
+
+        f->mapsize = f->size;
+    }
+
+    f->mapped = true;
+}
+
+
+PRIVATE int
+map_grow(struct file_rec *f, long need)
+{
+    long            newsize = f->mapsize * 2;
+    char           *newmap;
+
+    if (newsize < MAP_MINSIZE)
+        newsize = MAP_MINSIZE;
+
+    if (newsize < need)
+        newsize = need;
+
+    DBG_PRINTF(true, "Growing map of file %D to %D bytes", f->cfno,
+               newsize);
+
+    newmap = mmap(NULL, newsize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                  fileno(f->hfptr), 0);
+
+    if (newmap == MAP_FAILED)
+        return -1;
+
+    if (f->map)
+        munmap(f->map, f->mapsize);
+
+    f->map = newmap;
+    f->mapsize = newsize;
+
+    return 0;
+}
+
+
+PUBLIC int
+file_unmap(struct file_rec *f)
+{
+    int             result = 0;
+
+    if (!f->mapped)
+        return 0;
+
+    f->mapped = false;
+
+    if (f->map) {
+        if (msync(f->map, f->mapsize, MS_SYNC) < 0)
+            result = -1;
+
+        munmap(f->map, f->mapsize);
+        f->map = NULL;
+    }
+
+    if (fseek(f->hfptr, f->pos, SEEK_SET) < 0)
+        result = -1;
+
+    return result;
+}
+
+
+PRIVATE bool
+is_regular(FILE *fp)
+{
+    struct stat     st;
+
+    return fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+
+/*
+ * INPUT FILE and SELECT INPUT read their text through a line_reader, a
+ * large buffer that is split into lines in place. The stdio position of
+ * the file runs ahead of the lines handed out; file_unread() sets it
+ * back before the file is accessed in any other way.
+ */
+PRIVATE void
+reader_reset(struct line_reader *r, FILE *fp)
+{
+    r->fp = fp;
+    r->start = 0;
+    r->end = 0;
+    r->eof = false;
+
+    /*
+     * Pipes and terminals are read a line at a time, so that a line is
+     * taken as soon as it is there
+     */
+    r->bylines = (fp && !is_regular(fp));
+}
+
+
+PRIVATE void
+reader_init(int pool, struct line_reader *r, FILE *fp)
+{
+    r->size = INPUT_BUFSIZE;
+    r->buf = (char *) mem_alloc(pool, r->size + 1);
+    reader_reset(r, fp);
+}
+
+
+/*
+ * Return the next line without its line end (LF or CR LF), or NULL at
+ * the end of the file or on a read error. The line stays valid until
+ * the next call.
+ */
+PRIVATE char   *
+reader_line(struct line_reader *r)
+{
+    char           *line;
+    char           *nl;
+    long            got;
+
+    while (true) {
+        line = r->buf + r->start;
+        nl = (char *) memchr(line, '\n', r->end - r->start);
+
+        if (nl) {
+            r->start = nl - r->buf + 1;
+        } else if (r->eof && r->start < r->end) {
+            nl = r->buf + r->end;       /* Last line without line end */
+            r->start = r->end;
+        } else if (r->eof) {
+            return NULL;
+        }
+
+        if (nl) {
+            if (nl > line && nl[-1] == '\r')
+                nl--;
+
+            *nl = '\0';
+
+            return line;
+        }
+
+        if (r->start > 0) {
+            memmove(r->buf, line, r->end - r->start);
+            r->end -= r->start;
+            r->start = 0;
+        } else if (r->end == r->size) {
+            r->size *= 2;
+            r->buf = (char *) mem_realloc(r->buf, r->size + 1);
+        }
+
+        if (r->bylines) {
+            if (fgets(r->buf + r->end, r->size - r->end + 1, r->fp))
+                got = strlen(r->buf + r->end);
+            else
+                got = 0;
+        } else {
+            got = fread(r->buf + r->end, 1, r->size - r->end, r->fp);
+        }
+
+        if (got == 0) {
+            if (ferror(r->fp))
+                return NULL;
+
+            r->eof = true;
+        }
+
+        r->end += got;
+    }
+}
+
+
+PUBLIC int
+file_unread(struct file_rec *f)
+{
+    struct line_reader *r = f->reader;
+    int             result = 0;
+
+    if (!r)
+        return 0;
+
+    if (r->end > r->start
+        && fseek(f->hfptr, r->start - r->end, SEEK_CUR) < 0)
+        result = -1;
+
+    reader_reset(r, f->hfptr);
+
+    return result;
+}
+
+
+PUBLIC int
+file_close(struct file_rec *f)
+{
+    int             result = file_flushrec(f);
+
+    if (file_unmap(f) != 0)
+        result = -1;
+
+    if (f->wbuf) {
+        mem_free(f->wbuf);
+        f->wbuf = NULL;
+    }
+
+    if (f->reader) {
+        mem_free(f->reader->buf);
+        mem_free(f->reader);
+        f->reader = NULL;
+    }
+
+    if (fclose(f->hfptr) == EOF)
+        result = EOF;
+
+    if (f->outbuf) {
+        mem_free(f->outbuf);
+        f->outbuf = NULL;
+    }
+
+    return result;
+}
+
+
+PRIVATE void
+exec_open(struct comal_line *line)
+{
+    struct string  *name;
+    enum VAL_TYPE   type;
+    struct file_rec *frec;
+    struct open_rec *o = &line->lc.openrec;
+    const char     *flags;
+    char           *fname;
+
+    calc_exp(o->filename, (void **) &name, &type);
+    frec =
+        (struct file_rec *) mem_alloc(RUN_POOL, sizeof(struct file_rec));
+    frec->cfno = calc_intexp(o->filenum);
+
+    if (fsearch(frec->cfno))
+        run_error(OPEN_ERR, "File %D already open", frec->cfno);
+
+    frec->mode = o->type;
+    frec->read_only = false;
+    frec->reader = NULL;
+    frec->outbuf = NULL;
+    frec->wbuf = NULL;
+    frec->wlen = 0;
+
+    switch (frec->mode) {
+    case readSYM:
+        flags = "rb";
+        frec->read_only = true;
+        break;
+
+    case writeSYM:
+        flags = "wbx";
+        break;
+
+    case appendSYM:
+        flags = "ab";
+        break;
+
+    case randomSYM:
+        frec->reclen = calc_intexp(o->reclen);
+
+        if (frec->reclen <= 0)
+            run_error(OPEN_ERR, "Invalid record length %D", frec->reclen);
+
+        if (o->read_only) {
+            flags = "rb";
+            frec->read_only = true;
+        } else {
+            flags = "rb+";
+        }
+
+        break;
+
+    default:
+        IP(false, "open filemode switch default action");
+    }
+
+    fname = str_ltou(name->s);
+    if (frec->mode == randomSYM && !o->read_only
+        && access(fname, F_OK) != 0) {
+        // The modern replacement for creat(2)
+        int             fd =
+            open(fname, O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR);
+        if (fd < 0) {
+            run_error(OPEN_ERR, "OPEN error: %s", strerror(errno));
+        }
+        close(fd);
+    }
+    frec->hfptr = fopen(fname, flags);
+
+    if (frec->hfptr == NULL)
+        run_error(OPEN_ERR, "OPEN error: %s", strerror(errno));
+
+    if (frec->mode == randomSYM) {
+        map_open(frec);
+    } else {
+        frec->mapped = false;
+
+        /*
+         * PRINT FILE writes behind into a large buffer. Terminals,
+         * pipes and FIFOs keep the stdio default, so that not much
+         * output is held back from whoever is at the other end.
+         */
+        if (!frec->read_only && is_regular(frec->hfptr)) {
+            frec->outbuf = (char *) mem_alloc(RUN_POOL, OUTPUT_BUFSIZE);
+            setvbuf(frec->hfptr, frec->outbuf, _IOFBF, OUTPUT_BUFSIZE);
+        }
+    }
+
+    file_add(frec);
+}
+
+
+PRIVATE void
+exec_create(struct comal_line *line)
+{
+    struct create_rec *c = &line->lc.createrec;
+    struct string  *name;
+    enum VAL_TYPE   type;
+    char           *fname;
+    FILE           *f;
+
+    calc_exp(c->filename, (void **) &name, &type);
+    fname = str_ltou(name->s);
+    f = fopen(fname, "wbx");
+    if (f == NULL) {
+        run_error(OPEN_ERR, "OPEN error: %s", strerror(errno));
+    }
+    fseek(f, calc_intexp(c->top) * calc_intexp(c->reclen) - 1, SEEK_SET);
+    fputc(0, f);
+    fclose(f);
+}
+
+
+PRIVATE void
+exec_close(struct comal_line *line)
+{
+    struct exp_list *work = line->lc.exproot;
+    struct file_rec *walk;
+    long            fno;
+
+    if (!work) {
+        while ((walk = file_first()) != NULL) {
+            DBG_PRINTF(true, "Closing Comal file %D", walk->cfno);
+
+            file_remove(walk);
+
+            if (file_close(walk) != 0)
+                run_error(CLOSE_ERR,
+                          "Close error on file %D: %s",
+                          walk->cfno, strerror(errno));
+
+            mem_free(walk);
+        }
+    } else {
+        while (work) {
+            fno = calc_intexp(work->exp);
+            walk = fsearch(fno);
+
+            if (!walk)
+                run_error(CLOSE_ERR, "File %D not open", fno);
+
+            file_remove(walk);
+
+            if (file_close(walk) != 0)
+                run_error(CLOSE_ERR,
+                          "CLOSE error on file %D: %s",
+                          walk->cfno, strerror(errno));
+
+            mem_free(walk);
+            work = work->next;
+        }
+    }
+}
+
+
+/*
+ * Find the file and position it at the record for a RANDOM file. Only
+ * READ FILE and WRITE FILE (direct) use the mapping of a RANDOM file;
+ * other access switches the file back to stdio. The line buffer of
+ * INPUT FILE is kept only for further INPUT FILE on a sequential file.
+ */
+PRIVATE struct file_rec *
+pos_file(struct two_exp *r, bool direct)
+{
+    long            cfno = calc_intexp(r->exp1);
+    struct file_rec *f = fsearch(cfno);
+
+    if (!f)
+        run_error(POS_ERR, "File %D not open", cfno);
+
+    if (file_flushrec(f) != 0)
+        run_error(WRITE_ERR, "File write error: %s", strerror(errno));
+
+    if (f->mapped && !direct && file_unmap(f) != 0)
+        run_error(POS_ERR, "Random file positioning error: %s",
+                  strerror(errno));
+
+    if (f->reader && (direct || f->mode == randomSYM)
+        && file_unread(f) != 0)
+        run_error(POS_ERR, "File positioning error: %s", strerror(errno));
+
+    if (f->mode == randomSYM) {
+        long            recno;
 
         if (!r->exp2)
             run_error(POS_ERR, "Record number needed for a RANDOM file");
@@ -1471,7 +2164,9 @@ pos_file(struct two_exp *r)
                    "Positioning file %D (host=%p) to record %D, offset %D",
                    f->cfno, f->hfptr, recno, (recno - 1) * f->reclen);
 
-        if (fseek(f->hfptr, (recno - 1) * f->reclen, SEEK_SET) == -1)
+        if (f->mapped)
+            f->pos = (recno - 1) * f->reclen;
+        else if (fseek(f->hfptr, (recno - 1) * f->reclen, SEEK_SET) == -1)
             run_error(POS_ERR,
                       "Random file positioning error: %s",
                       strerror(errno));
@@ -1481,15 +2176,50 @@ pos_file(struct two_exp *r)
 }
 
 
+/*
+ * Return the mapped bytes at the position of a RANDOM file, at most
+ * size, and advance past them
+ */
+PRIVATE const char *
+map_read(struct file_rec *f, long *size)
+{
+    const char     *p = f->map + f->pos;
+    long            avail = f->size - f->pos;
+
+    if (avail < 0)
+        avail = 0;
+
+    if (*size > avail)
+        *size = avail;
+
+    f->pos += *size;
+
+    return p;
+}
+
+
+PRIVATE long
+rec_read(struct file_rec *f, void *buf, long size)
+{
+    if (!f->mapped)
+        return fread(buf, 1, size, f->hfptr);
+
+    memcpy(buf, map_read(f, &size), size);
+
+    return size;
+}
+
+
 PRIVATE void
 read1(struct file_rec *f, struct id_rec *id, void **data,
       enum VAL_TYPE *type, long *totsize)
 {
     long            size;
     int             c;
+    unsigned char   b;
 
     *type = (enum VAL_TYPE) 0;
-    c = fgetc(f->hfptr);
+    c = rec_read(f, &b, 1) == 1 ? b : EOF;
     *type = (enum VAL_TYPE) c;
 
     if (c != EOF) {
@@ -1513,7 +2243,7 @@ read1(struct file_rec *f, struct id_rec *id, void **data,
             break;
 
         case V_STRING:
-            r = fread(&size, sizeof(long), 1, f->hfptr);
+            r = rec_read(f, &size, sizeof(long)) / sizeof(long);
             break;
 
         default:
@@ -1537,11 +2267,10 @@ read1(struct file_rec *f, struct id_rec *id, void **data,
 
             if (*type == V_STRING) {
                 *data = STR_ALLOC(RUN_POOL, size);
-                r = fread((*(struct string **) data)->s, 1, size,
-                          f->hfptr);
+                r = rec_read(f, (*(struct string **) data)->s, size);
                 (*(struct string **) data)->len = size;
             } else {
-                r = fread((char *) *data, 1, size, f->hfptr);
+                r = rec_read(f, *data, size);
             }
             if (r == size) {
                 return;
@@ -1555,10 +2284,87 @@ read1(struct file_rec *f, struct id_rec *id, void **data,
 }
 
 
+/*
+ * Read nr numbers of the type of id into lval, an array of ltype.
+ * Does the same as calling read1() nr times, but in blocks and without
+ * allocating a cell for each number.
+ */
+PRIVATE void
+read_nums(struct file_rec *f, struct id_rec *id, char HUGE_POINTER * lval,
+          enum VAL_TYPE ltype, long nr, long *totsize)
+{
+    enum VAL_TYPE   type = id->type;
+    long            size = type_size(type);
+    long            item = size + 1;    /* 1 extra for type byte */
+    long            chunk;
+    long            got;
+    long            i;
+    const char     *buf;
+    union {
+        long            num;
+        double          fnum;
+    } value;
+
+    while (nr > 0) {
+        chunk = RECORD_BUFSIZE / item;
+
+        if (chunk > nr)
+            chunk = nr;
+
+        if (f->mapped) {
+            got = chunk * item;
+            buf = map_read(f, &got);
+        } else {
+            got = fread(rec_buf, 1, chunk * item, f->hfptr);
+            buf = rec_buf;
+        }
+
+        for (i = 0; i < got; i += item) {
+            if ((unsigned char) buf[i] != type)
+                run_error(READ_ERR,
+                          "INPUT/READ from file, wrong type (%s)",
+                          id->name);
+
+            if (f->mode == randomSYM) {
+                *totsize += item;
+
+                if (*totsize > f->reclen)
+                    run_error(READ_ERR, "Random file record overflow");
+            }
+
+            /*
+             * The last number may have been cut short by end of file 
+             */
+            value.num = 0;
+            value.fnum = 0;
+            memcpy(&value, buf + i + 1,
+                   got - i < item ? got - i - 1 : size);
+            val_copy(lval, &value, ltype, type);
+            lval += type_size(ltype);
+            nr--;
+        }
+
+        if (got < chunk * item)
+            break;
+    }
+
+    if (nr == 0)
+        return;
+
+    if (ferror(f->hfptr))
+        run_error(READ_ERR, "INPUT/READ file error: %s", strerror(errno));
+
+    /*
+     * End of file: fails like read1() would 
+     */
+    val_copy(lval, &value, ltype, (enum VAL_TYPE) EOF);
+}
+
+
 PUBLIC void
 do_readfile(struct two_exp *twoexp, struct exp_list *lvalroot)
 {
-    struct file_rec *f = pos_file(twoexp);
+    struct file_rec *f = pos_file(twoexp, true);
     struct exp_list *work = lvalroot;
     void           *result;
     enum VAL_TYPE   ltype;
@@ -1582,19 +2388,18 @@ do_readfile(struct two_exp *twoexp, struct exp_list *lvalroot)
 
         size = type_size(ltype);
 
-        for (; nr > 0; --nr) {
-            read1(f, work->exp->e.expid.id, &result, &rtype, &totsize);
-
-            if (ltype == V_STRING)
+        if (ltype != V_STRING)
+            read_nums(f, work->exp->e.expid.id, lval, ltype, nr,
+                      &totsize);
+        else
+            for (; nr > 0; --nr) {
+                read1(f, work->exp->e.expid.id, &result, &rtype,
+                      &totsize);
                 do_str_assign((struct string **) lval,
                               work->exp->e.expsid.twoexp, strl,
                               (struct string *) result, 1);
-            else
-                do_num_assign((void *) lval, ltype, NULL, result,
-                              rtype, 1);
-
-            lval += size;
-        }
+                lval += size;
+            }
 
         work = work->next;
     }
@@ -1638,11 +2443,83 @@ exec_read(struct comal_line *line)
 }
 
 
+PRIVATE int
+rec_out(struct file_rec *f, const void *data, long size)
+{
+    if (f->mapped) {
+        if (f->pos + size > f->mapsize && map_grow(f, f->pos + size) != 0)
+            return -1;
+
+        if (f->pos + size > f->size) {
+            if (ftruncate(fileno(f->hfptr), f->pos + size) < 0)
+                return -1;
+
+            f->size = f->pos + size;
+        }
+
+        memcpy(f->map + f->pos, data, size);
+        f->pos += size;
+    } else if (fwrite(data, 1, size, f->hfptr) != (size_t) size
+               && ferror(f->hfptr))
+        return -1;
+
+    return 0;
+}
+
+
+PRIVATE void
+rec_write(struct file_rec *f, const void *data, long size)
+{
+    if (rec_out(f, data, size) != 0)
+        run_error(WRITE_ERR, "File write error: %s", strerror(errno));
+}
+
+
+PUBLIC int
+file_flushrec(struct file_rec *f)
+{
+    long            len = f->wlen;
+
+    f->wlen = 0;
+
+    return len ? rec_out(f, f->wbuf, len) : 0;
+}
+
+
+PRIVATE void
+rec_flush(struct file_rec *f)
+{
+    if (file_flushrec(f) != 0)
+        run_error(WRITE_ERR, "File write error: %s", strerror(errno));
+}
+
+
+PRIVATE void
+rec_put(struct file_rec *f, const void *data, long size)
+{
+    if (f->wlen + size > RECORD_BUFSIZE) {
+        rec_flush(f);
+
+        if (size > RECORD_BUFSIZE) {
+            rec_write(f, data, size);
+
+            return;
+        }
+    }
+
+    memcpy(f->wbuf + f->wlen, data, size);
+    f->wlen += size;
+}
+
+
+/*
+ * Add one value to the record in f->wbuf: a type byte, for strings the
+ * length, and then the value itself
+ */
 PRIVATE void
 write1(struct file_rec *f, void *data, enum VAL_TYPE type, long *totsize)
 {
-    long            size;
-    long            w;
+    long            size = 0;
     char            c;
 
     switch (type) {
@@ -1668,86 +2545,95 @@ write1(struct file_rec *f, void *data, enum VAL_TYPE type, long *totsize)
         if (type == V_STRING)
             *totsize += sizeof(long);   /* str size */
 
-        if (*totsize > f->reclen)
+        if (*totsize > f->reclen) {
+            rec_flush(f);
             run_error(WRITE_ERR, "Random file record overflow");
+        }
     }
 
+    DBG_PRINTF(true,
+               "Writing %D bytes to file %D (host %p)",
+               size, f->cfno, f->hfptr);
+
     c = (char) type;
-    w = fputc(c, f->hfptr);
 
-    if (w != EOF) {
-        DBG_PRINTF(true,
-                   "Writing %D bytes to file %D (host %p)",
-                   size, f->cfno, f->hfptr);
+    if (f->wlen + 1 + size <= RECORD_BUFSIZE && type != V_STRING) {
+        f->wbuf[f->wlen] = c;
+        memcpy(f->wbuf + f->wlen + 1, data, size);
+        f->wlen += 1 + size;
+    } else {
+        rec_put(f, &c, 1);
 
         if (type == V_STRING) {
-            w = fwrite(&size, sizeof(long), 1, f->hfptr);
-
-            if (w > 0) {
-                w = fwrite(((struct string *) data)->s, 1, size, f->hfptr);
-            }
-        } else {
-            w = fwrite((char *) data, 1, size, f->hfptr);
-        }
-        if (w == size) {
-            return;
-        }
-    }
+            rec_put(f, &size, sizeof(long));
 
-    if (ferror(f->hfptr)) {
-        run_error(WRITE_ERR, "File write error: %s", strerror(errno));
+            if (size)
+                rec_put(f, ((struct string *) data)->s, size);
+        } else
+            rec_put(f, data, size);
     }
 }
 
 
+/*
+ * All values of a WRITE FILE statement are collected in the write
+ * buffer of the file, and written to the file in one go. A FUNC in one
+ * of the values that accesses the same file goes through pos_file(),
+ * which writes out what has been collected so far first.
+ */
 PUBLIC void
 exec_write(struct comal_line *line)
 {
-    struct file_rec *f = pos_file(&line->lc.writerec.twoexp);
+    struct file_rec *f = pos_file(&line->lc.writerec.twoexp, true);
     struct exp_list *work = line->lc.writerec.exproot;
     enum VAL_TYPE   type;
     long            totsize = 0;
     char HUGE_POINTER *result;
+    void           *value;
     long            nr;
     struct var_item *var;
 
     if (f->read_only)
         run_error(WRITE_ERR, "File open for READ (only)");
 
+    if (!f->wbuf)
+        f->wbuf = (char *) mem_alloc(RUN_POOL, RECORD_BUFSIZE);
+
     while (work) {
         int             size;
 
-        calc_exp(work->exp, (void **) &result, &type);
+        calc_exp(work->exp, &value, &type);
 
         if (type == V_ARRAY) {
-            var = (struct var_item *) result;
+            var = (struct var_item *) value;
             result = (char *) &var->data.str[0];
-            nr = var->array->nritems;
             type = var->type;
-        } else
-            nr = 1;
-
-        size = type_size(type);
-
-        for (; nr > 0; --nr) {
-            write1(f,
-                   (type ==
-                    V_STRING) ? (void *) *(struct string **) result : (void
-                                                                       *)
-                   result, type, &totsize);
-            result += size;
+            size = type_size(type);
+
+            for (nr = var->array->nritems; nr > 0; --nr) {
+                write1(f,
+                       (type ==
+                        V_STRING) ? (void *) *(struct string **) result
+                       : (void *) result, type, &totsize);
+                result += size;
+            }
+        } else {
+            write1(f, value, type, &totsize);
+            val_free(value, type);
         }
 
         work = work->next;
     }
+
+    rec_flush(f);
 }
 
 PUBLIC void
 print_file(struct two_exp *twoexp,
            struct print_list *printroot, int pr_sep,
-           struct expression *using_modifier)
+           struct print_modifier *using_modifier)
 {
-    struct file_rec *f = pos_file(twoexp);
+    struct file_rec *f = pos_file(twoexp, false);
 
     if (f->read_only)
         run_error(WRITE_ERR, "File open for READ (only)");
@@ -1755,7 +2641,7 @@ print_file(struct two_exp *twoexp,
     prev_sel_file = sel_outfile;
     sel_outfile = f->hfptr;
     in_print_file = true;
-    if (using_modifier == NULL) {
+    if (using_modifier->c_using == NULL) {
         print_con(printroot, pr_sep);
     } else {
         print_using(using_modifier, printroot, pr_sep);
@@ -1763,6 +2649,11 @@ print_file(struct two_exp *twoexp,
     sel_outfile = prev_sel_file;
     prev_sel_file = NULL;
     in_print_file = false;
+
+    if (ferror(f->hfptr)) {
+        clearerr(f->hfptr);
+        run_error(WRITE_ERR, "File write error: %s", strerror(errno));
+    }
 }
 
 
@@ -1826,40 +2717,134 @@ format_using(char *u, char *p)
 }
 
 
+/*
+ * Copy the text up to the next '#' of a USING picture to *to
+ */
 PRIVATE char   *
-put_using(char *s)
+using_text(char **s, char **to)
 {
-    char            str[MAX_LINELEN];
-    char           *from,
-                   *to;
+    char           *from = *s;
+    char           *start = *to;
 
-    from = s;
-    to = str;
-    while (*from != '\0' && *from != '#' && to < &str[MAX_LINELEN - 1]) {
-        *to = *from;
-        from++;
-        to++;
+    while (*from != '\0' && *from != '#' && *to - start < MAX_LINELEN - 1)
+        *(*to)++ = *from++;
+
+    *(*to)++ = '\0';
+    *s = from;
+
+    return start;
+}
+
+
+/*
+ * Split a USING picture into the text before the first field and its
+ * number fields, each with the text that follows it
+ */
+PRIVATE struct using_fmt *
+using_compile(struct mem_pool *pool, char *picture)
+{
+    struct using_fmt *u;
+    char            fmt[FLOATUSING_MAX];
+    char            text[MAX_LINELEN];
+    char           *p;
+    char           *to;
+    int             n = 0;
+
+    p = picture;
+    to = text;
+    using_text(&p, &to);
+
+    while (*p) {
+        p = format_using(p, fmt);
+        n++;
+
+        if (*p) {
+            to = text;
+            using_text(&p, &to);
+        }
     }
-    *to = '\0';
-    my_put(MSG_PROGRAM, str, -1L);
-    return from;
+
+    using_compiles++;
+    u = mem_alloc_private(pool,
+                          sizeof(struct using_fmt) +
+                          n * sizeof(struct using_field) +
+                          strlen(picture) + n + 1);
+    u->nrfields = n;
+    to = (char *) &u->field[n];
+    p = picture;
+    u->lead = using_text(&p, &to);
+
+    for (n = 0; *p; n++) {
+        p = format_using(p, u->field[n].fmt);
+
+        if (*p)
+            u->field[n].lit = using_text(&p, &to);
+    }
+
+    return u;
+}
+
+
+PRIVATE void
+using_flush(char *buf, long *len)
+{
+    if (*len > 0)
+        my_put(MSG_PROGRAM, buf, *len);
+
+    *len = 0;
 }
 
 
 PRIVATE void
-print_using(struct expression *str,
+using_put(char *buf, long *len, const char *s)
+{
+    long            l = strlen(s);
+
+    if (*len + l >= USING_BUFSIZE)
+        using_flush(buf, len);
+
+    memcpy(buf + *len, s, l + 1);
+    *len += l;
+}
+
+
+/*
+ * A constant USING picture is compiled once and kept with the PRINT
+ * statement. The whole line is collected in buf before it is put out.
+ */
+PRIVATE void
+print_using(struct print_modifier *m,
             struct print_list *printroot, int pr_sep)
 {
-    struct string  *usingstr;
-    char            floatusing[FLOATUSING_MAX];
+    static const struct using_field nofield = { "%0.0f", NULL };
+    struct using_fmt *u = m->using_fmt;
+    struct string  *usingstr = NULL;
+    const struct using_field *f;
+    char            buf[USING_BUFSIZE];
+    long            len = 0;
     void           *result;
     double          d;
     enum VAL_TYPE   type;
     struct print_list *work = printroot;
-    char           *formatptr;
+    struct expression *pic = m->c_using;
+    int             n = 0;
+
+    if (!u) {
+        calc_exp(pic, (void **) &usingstr, &type);
+
+        if (pic->optype == T_EXP_IS_STRING)
+            pic = pic->e.exp;
+
+        if (pic->optype == T_STRING || pic->optype == T_FOLDED) {
+            u = m->using_fmt = using_compile(mem_poolof(m), usingstr->s);
+            mem_free(usingstr);
+            usingstr = NULL;
+        } else
+            u = using_compile(mem_poolof(usingstr), usingstr->s);
+    }
 
-    calc_exp(str, (void **) &usingstr, &type);
-    formatptr = put_using(usingstr->s);
+    buf[0] = '\0';
+    using_put(buf, &len, u->lead);
 
     while (work) {
         calc_exp(work->exp, &result, &type);
@@ -1870,15 +2855,26 @@ print_using(struct expression *str,
             d = *(double *) result;
 
         val_free(result, type);
-        formatptr = format_using(formatptr, floatusing);
-        my_printf(MSG_PROGRAM, false, floatusing, d);
-        if (*formatptr != '\0') {
-            formatptr = put_using(formatptr);
-        }
+        f = n < u->nrfields ? &u->field[n++] : &nofield;
+
+        if (len + MAX_LINELEN > USING_BUFSIZE)
+            using_flush(buf, &len);
+
+        Fmt_sfmt(buf + len, MAX_LINELEN, f->fmt, d);
+        len += strlen(buf + len);
+
+        if (f->lit)
+            using_put(buf, &len, f->lit);
 
         work = work->next;
     }
-    mem_free(usingstr);
+
+    using_flush(buf, &len);
+
+    if (usingstr) {
+        mem_free(u);
+        mem_free(usingstr);
+    }
 
     if (!pr_sep)
         my_nl(MSG_PROGRAM);
@@ -1890,7 +2886,7 @@ print_maybe_using(struct print_rec *p)
     if (p->modifier == NULL || p->modifier->c_using == NULL) {
         print_con(p->printroot, p->pr_sep);
     } else {
-        print_using(p->modifier->c_using, p->printroot, p->pr_sep);
+        print_using(p->modifier, p->printroot, p->pr_sep);
     }
 }
 
@@ -1916,13 +2912,15 @@ exec_print(struct comal_line *line)
             }
         } else if (p->modifier->type == fileSYM) {
             print_file(p->modifier->twoexp,
-                       p->printroot, p->pr_sep, p->modifier->c_using);
+                       p->printroot, p->pr_sep, p->modifier);
         } else {
             IP(false, "Bad print_rec.modifier.type");
         }
     } else {
         print_maybe_using(p);
     }
+
+    my_outcheck();
 }
 
 
@@ -2028,42 +3026,67 @@ exec_import(struct comal_line *line)
 PUBLIC void
 input_file(struct two_exp *twoexp, struct exp_list *lvalroot)
 {
-    struct file_rec *f = pos_file(twoexp);
+    struct file_rec *f = pos_file(twoexp, false);
+
+    if (!f->reader) {
+        f->reader =
+            (struct line_reader *) mem_alloc(RUN_POOL,
+                                             sizeof(struct line_reader));
+        reader_init(RUN_POOL, f->reader, f->hfptr);
+    }
 
-    prev_sel_file = sel_infile;
-    sel_infile = f->hfptr;
-    in_input_file = true;
+    input_frec = f;
     input_con(NULL, NULL, lvalroot, commaSYM);
-    sel_infile = prev_sel_file;
-    prev_sel_file = NULL;
-    in_input_file = false;
+    input_frec = NULL;
 }
 
 
+/*
+ * Get the next line of input into *line: from the file of INPUT FILE,
+ * the SELECT INPUT file or else the console (through s)
+ */
 PRIVATE bool
-input_line(char *s, long len, const char *p)
+input_line(char **line, char *s, long len, const char *p)
 {
-    bool            esc;
+    if (input_frec) {
+        *line = reader_line(input_frec->reader);
+
+        if (!*line) {
+            if (ferror(input_frec->hfptr))
+                run_error(READ_ERR, "INPUT/READ file error: %s",
+                          strerror(errno));
+
+            run_error(READ_ERR, "End of file %D", input_frec->cfno);
+        }
+
+        return false;
+    }
 
     if (sel_infile) {
-        if (!fgets(s, len - 1, sel_infile)) {
-            if (feof(sel_infile)) {
-                fclose(sel_infile);
-                sel_infile = NULL;
+        if (!sel_reader.buf)
+            reader_init(MISC_POOL, &sel_reader, sel_infile);
+        else if (sel_reader.fp != sel_infile)
+            reader_reset(&sel_reader, sel_infile);
 
-                DBG_PRINTF(true, "Closing SELINPUT file");
-            } else
-                run_error(SELECT_ERR,
-                          "Read error when reading SELECT INPUT file");
-        } else {
-            *(s + strlen(s) - 1) = '\0';        /* overwrite \n */
+        *line = reader_line(&sel_reader);
+
+        if (*line)
             return false;
-        }
+
+        if (ferror(sel_infile))
+            run_error(SELECT_ERR,
+                      "Read error when reading SELECT INPUT file");
+
+        fclose(sel_infile);
+        sel_infile = NULL;
+        reader_reset(&sel_reader, NULL);
+
+        DBG_PRINTF(true, "Closing SELINPUT file");
     }
 
-    esc = sys_get(MSG_PROGRAM, s, len, p);
+    *line = s;
 
-    return esc;
+    return sys_get(MSG_PROGRAM, s, len, p);
 }
 
 
@@ -2073,12 +3096,13 @@ input_con(struct expression *len, struct string *prompt,
 {
     struct exp_list *work = lvalroot;
     char            line[MAX_LINELEN];
-    char            field[MAX_LINELEN];
     char           *j;
     char           *i = NULL;
     int             nr;
-    int             n;
+    long            n;
     int             quote;
+    long            num;
+    double          d;
     bool            esc = false;
     const char     *p;
     long            l;
@@ -2096,11 +3120,10 @@ input_con(struct expression *len, struct string *prompt,
         l = MAX_LINELEN;
     }
 
-    esc = input_line(line, l, p);
-    i = line;
+    esc = input_line(&i, line, l, p);
 
     while (work) {
-        void           *data;
+        void           *data = NULL;
         int             must_free_mem;
         enum VAL_TYPE   type;
 
@@ -2113,8 +3136,7 @@ input_con(struct expression *len, struct string *prompt,
 
                 my_printf(MSG_DIALOG, true, "Please re-INPUT from start");
                 work = lvalroot;
-                esc = input_line(line, l, p);
-                i = line;
+                esc = input_line(&i, line, l, p);
             } else
                 run_error(ESCAPE_ERR, "%s",
                           catgets(catdesc, CommonSet, CommonEscape,
@@ -2130,56 +3152,59 @@ input_con(struct expression *len, struct string *prompt,
             if (*i)
                 break;
             else {
-                esc = input_line(line, l, "?? ");
-                i = line;
+                esc = input_line(&i, line, l, "?? ");
             }
         }
 
         DBG_PRINTF(true, "Assessing \"%s\" for input type %d", i, type);
 
-        n = 0;
-        data = field;
         must_free_mem = 0;
 
         switch (type) {
         case V_INT:
-            nr = sscanf(i, "%ld%n", (long *) field, &n);
-            i += n;
+            num = strtol(i, &j, 10);
+            data = &num;
+            nr = (j != i);
+            i = j;
             break;
 
         case V_FLOAT:
-            nr = sscanf(i, "%f%n", (double *) field, &n);
-            i += n;
+            d = val_strtod(i, &j);
+            data = &d;
+            nr = (j != i);
+            i = j;
             break;
 
         case V_STRING:
-            j = i;
-            n = -1;
-
-            quote = (*j == '"');
+            /*
+             * The field goes straight from the line into the string
+             * that is assigned
+             */
+            quote = (*i == '"');
 
             if (quote)
-                j++;
+                i++;
+
+            j = i;
 
-            while (*j && !((*j == ',' && !quote)
-                           || (*j == '"' && quote))) {
-                ++n;
-                field[n] = *j;
+            while (*j && *j != (quote ? '"' : ','))
                 j++;
-            }
 
-            while (isspace_l(field[n], latin_loc)
-                   && n >= 0)
+            n = j - i;
+
+            while (n > 0 && isspace_l(i[n - 1], latin_loc))
                 --n;
 
-            field[n + 1] = '\0';
-            i += n + 1;
+            data = STR_ALLOC(RUN_POOL, n);
+            ((struct string *) data)->len = n;
+            memcpy(((struct string *) data)->s, i, n);
 
-            if (quote)
-                i += 2;         /* Past the quotes */
+            i = j;
+
+            if (quote && *i)
+                i++;            /* Past the closing quote */
 
             nr = 1;
-            data = str_make(RUN_POOL, field);
             must_free_mem = 1;
             break;
 
@@ -2275,6 +3300,9 @@ exec_return(struct comal_line *line)
     if (curenv->running != RUNNING)
         run_error(DIRECT_ERR, "Can't RETURN in command mode");
 
+    if (line->lineptr && exec_tailcall(line, funcSYM))
+        return execSYM;
+
     if (line->lc.exp) {
         calc_exp(line->lc.exp, &result, &type);
         return_type = curenv->curenv->curproc->lc.pfrec.id->type;
@@ -2458,6 +3486,9 @@ exec_line(struct comal_line *line)
         return exec_for(line);
 
     case execSYM:
+        if (line->lineptr && exec_tailcall(line, procSYM))
+            return execSYM;
+
         do_call(line->lc.exp, procSYM);
         break;
 
@@ -2486,10 +3517,15 @@ exec_line(struct comal_line *line)
 
     case select_outputSYM:
         exec_selfile(&sel_outfile, line->lc.exp, "at");
+
+        if (sel_outfile && is_regular(sel_outfile))
+            setvbuf(sel_outfile, sel_outbuf, _IOFBF, OUTPUT_BUFSIZE);
+
         break;
 
     case select_inputSYM:
         exec_selfile(&sel_infile, line->lc.exp, "rt");
+        reader_reset(&sel_reader, sel_infile);
         break;
 
     case inputSYM:
@@ -2559,6 +3595,7 @@ exec_line(struct comal_line *line)
         break;
 
     case delaySYM:
+        sys_flush();
         sleep(calc_intexp(line->lc.exp));
         break;
 
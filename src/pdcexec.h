@@ -17,6 +17,12 @@
 
 #include "compat_cdefs.h"
 
+/** Maximum nesting of PROC/FUNC calls (SYS max_depth) */
+extern long     max_call_depth;
+
+/** Number of PRINT USING pictures compiled so far (SYS(using_compiles)) */
+extern long     using_compiles;
+
 /** Signal a run-time error  */
 extern void     run_error(int error, const char *s, ...);
 
@@ -30,6 +36,21 @@ extern int      exec_trap(struct comal_line *line);
 /** Return the metadata for an open file */
 extern struct file_rec *fsearch(long i);
 
+/** Switch a mapped RANDOM file back to plain stdio access */
+extern int      file_unmap(struct file_rec *f);
+
+/** Give back the buffered but unread input of INPUT FILE to stdio */
+extern int      file_unread(struct file_rec *f);
+
+/** Write out the values of an unfinished WRITE FILE statement */
+extern int      file_flushrec(struct file_rec *f);
+
+/** Close an open file, syncing its mapping if any */
+extern int      file_close(struct file_rec *f);
+
+/** Close all open files, ignoring errors */
+extern void     file_closeall(void);
+
 /** Read from a binary format file */
 extern void     do_readfile(struct two_exp *twoexp,
                             struct exp_list *lvalroot);
@@ -46,7 +67,7 @@ extern void     exec_write(struct comal_line *line);
 /** Print to a text format file */
 extern void     print_file(struct two_exp *twoexp,
                            struct print_list *printroot, int pr_sep,
-                           struct expression *using_modifier);
+                           struct print_modifier *using_modifier);
 
 /** Input from a text format file */
 extern void     input_file(struct two_exp *twoexp,
@@ -149,8 +149,11 @@ PRIVATE long
 my_highest_file(void)
 {
     struct file_rec *walk;
-    long            result = 0;
+    long            result = curenv->highfile;
 
+    /*
+     * Files numbered outside the file table 
+     */
     walk = curenv->fileroot;
     while (walk) {
         result = max(result, walk->cfno);
@@ -266,6 +269,15 @@ my_eof2(long fno)
     if (!f)
         run_error(EOF_ERR, "File not open");
 
+    if (file_flushrec(f) != 0)
+        run_error(EOF_ERR, "File error: %s", strerror(errno));
+
+    if (f->mapped)
+        return f->pos >= f->size;
+
+    if (f->reader && f->reader->start < f->reader->end)
+        return 0;
+
     c = fgetc(f->hfptr);
     result = feof(f->hfptr);
     if (!result) {
@@ -360,7 +372,7 @@ my_val(struct string **result, enum VAL_TYPE *type)
     double         *d = (double *) cell_alloc(FLOAT_CPOOL);
     char           *endptr;
 
-    *d = strtod((*result)->s, &endptr);
+    *d = val_strtod((*result)->s, &endptr);
 
     if (*endptr)
         run_error(VAL_ERR, "Conversion error when taking string VALue");
@@ -440,12 +452,12 @@ my_tab(void **result, enum VAL_TYPE *type)
 PRIVATE struct string *
 my_str(void **result, enum VAL_TYPE *type)
 {
-    char            buf[30];
+    char            buf[64];
 
     if (*type == V_INT) {
-        Fmt_sfmt(buf, 30, "%D", **(long **) result);
+        val_fmtint(buf, **(long **) result);
     } else {
-        Fmt_sfmt(buf, 30, "%G", **(double **) result);
+        val_fmtfloat(buf, **(double **) result, true);
     }
 
     *type = V_STRING;
@@ -674,12 +686,18 @@ exp_binary_s(int op, void **result, enum VAL_TYPE *type,
         mem_free(s2);
     } else if (op == timesSYM) {
         n = val_mustbelong(result2, type2, 1);
-        s2 = str_make2(RUN_POOL, n);
+
+        if (n < 0)
+            n = 0;
+
+        s2 = str_make2(RUN_POOL, n * s1->len);
 
         for (t = s2->s; n; n--, t += s1->len) {
             term_strncpy(t, s1->s, s1->len + 1);
         }
 
+        mem_free(s1);
+
         *result = s2;
         *type = V_STRING;
     } else
@@ -697,6 +715,10 @@ my_get(enum VAL_TYPE *type, long fno, long size)
     if (!f) {
         run_error(EOF_ERR, "File not open");
     }
+    if (file_flushrec(f) != 0 || file_unmap(f) != 0
+        || file_unread(f) != 0) {
+        run_error(EOF_ERR, "File error: %s", strerror(errno));
+    }
     s = STR_ALLOC(RUN_POOL, size);
     s->len = fread(s->s, 1, size, f->hfptr);
     s->s[s->len] = '\0';
@@ -719,7 +741,12 @@ exp_binary_i(int op, void **result, enum VAL_TYPE *type,
 
     switch (op) {
     case powerSYM:
-        *result = val_float(pow((double) *i1, (double) *i2), NULL, type);
+        if (*i2 == 2)
+            *result =
+                val_float((double) *i1 * (double) *i1, NULL, type);
+        else
+            *result =
+                val_float(pow((double) *i1, (double) *i2), NULL, type);
         cell_free(i1);
         cell_free(i2);
         break;
@@ -793,7 +820,10 @@ exp_binary_f(int op, void **result, enum VAL_TYPE *type,
     f2 = (double *) v2;
     switch (op) {
     case powerSYM:
-        *f1 = pow(*f1, *f2);
+        if (*f2 == 2)
+            *f1 = *f1 * *f1;
+        else
+            *f1 = pow(*f1, *f2);
         break;
     case plusSYM:
         *f1 = *f1 + *f2;
@@ -957,6 +987,79 @@ exp_rnd(struct expression *exp, double **result, enum VAL_TYPE *type)
     *type = V_FLOAT;
 }
 
+/*
+ * Check for x*1, x-0 and (for integer x) x+0, which are just x.
+ * Floating x+0 is left alone, since -0+0 gives +0.
+ */
+PRIVATE bool
+exp_identity(struct expression *exp, enum VAL_TYPE type1)
+{
+    struct expression *exp2 = exp->e.twoexp.exp2;
+
+    if (exp2->optype != T_INTNUM || type1 == V_STRING)
+        return false;
+
+    switch (exp->op) {
+    case timesSYM:
+        return exp2->e.num == 1;
+
+    case minusSYM:
+        return exp2->e.num == 0;
+
+    case plusSYM:
+        return exp2->e.num == 0 && type1 == V_INT;
+
+    default:
+        return false;
+    }
+}
+
+
+/*
+ * Apply a binary operator to two calculated operands
+ */
+PRIVATE void
+exp_binary_vals(int op, void **result, enum VAL_TYPE *type,
+                void *result1, enum VAL_TYPE type1,
+                void *result2, enum VAL_TYPE type2)
+{
+    void            (*func)(int op, void **result, enum VAL_TYPE * type,
+                            void *v1, void *v2) = NULL;
+    int             cmp;
+
+    if (relop(op)) {
+        cmp = val_cmp(op, result1, result2, type1, type2);
+        val_free(result1, type1);
+        val_free(result2, type2);
+        *result = val_int(cmp, NULL, type);
+    } else if (type1 == V_STRING)
+        exp_binary_s(op, result, type, (struct string *) result1,
+                     result2, type2);
+    else {
+        if (type1 != type2) {
+            if (type1 == V_INT)
+                result1 = val_float(*(long *) result1, result1, &type1);
+            else
+                result2 = val_float(*(long *) result2, result2, &type2);
+        }
+
+        switch (type1) {
+        case V_INT:
+            func = exp_binary_i;
+            break;
+        case V_FLOAT:
+            func = exp_binary_f;
+            break;
+
+        default:
+            IP(false, "exp_binary subexp type default action");
+        }
+
+        (*func) (op, result, type, result1, result2);
+    }
+}
+
+
 PRIVATE void
 exp_binary(struct expression *exp, void **result, enum VAL_TYPE *type)
 {
@@ -964,9 +1067,6 @@ exp_binary(struct expression *exp, void **result, enum VAL_TYPE *type)
                    *result2;
     enum VAL_TYPE   type1,
                     type2;
-    void            (*func)(int op, void **result, enum VAL_TYPE * type,
-                            void *v1, void *v2) = NULL;
-    int             cmp;
 
     if (logop(exp->op))
         *result =
@@ -977,41 +1077,249 @@ exp_binary(struct expression *exp, void **result, enum VAL_TYPE *type)
         exp_rnd(exp, (double **) result, type);
     else {
         calc_exp(exp->e.twoexp.exp1, &result1, &type1);
+
+        if (exp_identity(exp, type1)) {
+            *result = result1;
+            *type = type1;
+            return;
+        }
+
         calc_exp(exp->e.twoexp.exp2, &result2, &type2);
+        exp_binary_vals(exp->op, result, type, result1, type1, result2,
+                        type2);
+    }
+}
 
-        if (relop(exp->op)) {
-            cmp = val_cmp(exp->op, result1, result2, type1, type2);
-            val_free(result1, type1);
-            val_free(result2, type2);
-            *result = val_int(cmp, NULL, type);
-        } else if (type1 == V_STRING)
-            exp_binary_s(exp->op, result, type, (struct string *) result1,
-                         result2, type2);
-        else {
-            if (type1 != type2) {
-                if (type1 == V_INT)
-                    result1 =
-                        val_float(*(long *) result1, result1, &type1);
-                else
-                    result2 =
-                        val_float(*(long *) result2, result2, &type2);
-            }
 
-            switch (type1) {
-            case V_INT:
-                func = exp_binary_i;
-                break;
-            case V_FLOAT:
-                func = exp_binary_f;
-                break;
+/** Room for a number, see exp_operand() */
+union exp_num {
+    long            num;
+    double          fnum;
+};
 
-            default:
-                IP(false, "exp_binary subexp type default action");
-            }
 
-            (*func) (exp->op, result, type, result1, result2);
+/*
+ * Get the value of a comparison operand. Number constants and simple
+ * variables are copied into *local rather than a newly allocated cell.
+ * Returns true if the result must be freed.
+ */
+PRIVATE bool
+exp_operand(struct expression *exp, void **result, enum VAL_TYPE *type,
+            union exp_num *local)
+{
+    struct var_item *var;
+    void           *lval;
+
+    switch (exp->optype) {
+    case T_INTNUM:
+        local->num = exp->e.num;
+        *result = &local->num;
+        *type = V_INT;
+        return false;
+
+    case T_FLOAT:
+        local->fnum = exp->e.fnum.val;
+        *result = &local->fnum;
+        *type = V_FLOAT;
+        return false;
+
+    case T_ID:
+        if (exp->e.expid.exproot)
+            break;
+
+        lval = exp_lval(exp, type, &var, NULL);
+
+        if (!lval || *type == V_ARRAY)
+            break;
+
+        if (*type == V_INT) {
+            local->num = *(long *) lval;
+            *result = &local->num;
+        } else {
+            local->fnum = *(double *) lval;
+            *result = &local->fnum;
         }
+
+        return false;
+
+    default:
+        break;
+    }
+
+    calc_exp(exp, result, type);
+
+    return true;
+}
+
+
+/*
+ * Evaluate a comparison of two numbers (a T_BINARY_I or T_BINARY_F
+ * with a relational operator)
+ */
+PRIVATE int
+exp_compare(struct expression *exp)
+{
+    void           *result1,
+                   *result2;
+    enum VAL_TYPE   type1,
+                    type2;
+    union exp_num   local1,
+                    local2;
+    bool            free1,
+                    free2;
+    int             cmp;
+
+    free1 = exp_operand(exp->e.twoexp.exp1, &result1, &type1, &local1);
+    free2 = exp_operand(exp->e.twoexp.exp2, &result2, &type2, &local2);
+
+    cmp = val_cmp(exp->op, result1, result2, type1, type2);
+
+    if (free1)
+        val_free(result1, type1);
+
+    if (free2)
+        val_free(result2, type2);
+
+    return cmp;
+}
+
+
+/*
+ * T_BINARY_I and T_BINARY_F nodes (see exp_typed()) are arithmetic or
+ * comparisons on operands whose type is known from their names. A NAME
+ * parameter can still bring in a value of another type, so the types
+ * are checked once and anything unexpected takes the general route.
+ */
+PRIVATE void
+exp_binary_int(struct expression *exp, void **result, enum VAL_TYPE *type)
+{
+    void           *result1,
+                   *result2;
+    enum VAL_TYPE   type1,
+                    type2;
+    long           *i1,
+                   *i2;
+
+    if (relop(exp->op)) {
+        *result = val_int(exp_compare(exp), NULL, type);
+        return;
+    }
+
+    calc_exp(exp->e.twoexp.exp1, &result1, &type1);
+
+    if (exp_identity(exp, type1)) {
+        *result = result1;
+        *type = type1;
+        return;
+    }
+
+    calc_exp(exp->e.twoexp.exp2, &result2, &type2);
+
+    if (type1 != V_INT || type2 != V_INT) {
+        exp_binary_vals(exp->op, result, type, result1, type1, result2,
+                        type2);
+        return;
     }
+
+    i1 = (long *) result1;
+    i2 = (long *) result2;
+
+    switch (exp->op) {
+    case plusSYM:
+        val_intadd(i1, i2, result, type);
+        break;
+    case minusSYM:
+        val_intsub(i1, i2, result, type);
+        break;
+    case timesSYM:
+        val_intmul(i1, i2, result, type);
+        break;
+    case divideSYM:
+        val_intdiv(i1, i2, result, type);
+        break;
+
+    default:
+        IP(false, "exp_binary_int default action");
+    }
+}
+
+
+PRIVATE void
+exp_binary_float(struct expression *exp, void **result,
+                 enum VAL_TYPE *type)
+{
+    void           *result1,
+                   *result2;
+    enum VAL_TYPE   type1,
+                    type2;
+    double          d1,
+                    d2;
+    double         *f;
+
+    if (relop(exp->op)) {
+        *result = val_int(exp_compare(exp), NULL, type);
+        return;
+    }
+
+    calc_exp(exp->e.twoexp.exp1, &result1, &type1);
+
+    if (exp_identity(exp, type1)) {
+        *result = result1;
+        *type = type1;
+        return;
+    }
+
+    calc_exp(exp->e.twoexp.exp2, &result2, &type2);
+
+    if ((type1 != V_FLOAT && type2 != V_FLOAT)
+        || type1 == V_STRING || type2 == V_STRING) {
+        exp_binary_vals(exp->op, result, type, result1, type1, result2,
+                        type2);
+        return;
+    }
+
+    d1 = type1 == V_INT ? *(long *) result1 : *(double *) result1;
+    d2 = type2 == V_INT ? *(long *) result2 : *(double *) result2;
+
+    switch (exp->op) {
+    case plusSYM:
+        d1 = d1 + d2;
+        break;
+    case minusSYM:
+        d1 = d1 - d2;
+        break;
+    case timesSYM:
+        d1 = d1 * d2;
+        break;
+    case divideSYM:
+        check0(d2 == 0);
+        d1 = d1 / d2;
+        break;
+    case powerSYM:
+        if (d2 == 2)
+            d1 = d1 * d1;
+        else
+            d1 = pow(d1, d2);
+        break;
+
+    default:
+        IP(false, "exp_binary_float default action");
+    }
+
+    /*
+     * Put the result in whichever operand cell holds a float 
+     */
+    if (type1 == V_FLOAT) {
+        f = (double *) result1;
+        cell_free(result2);
+    } else {
+        f = (double *) result2;
+        cell_free(result1);
+    }
+
+    *f = d1;
+    *result = f;
+    *type = V_FLOAT;
 }
 
 
@@ -1250,53 +1558,135 @@ exp_reexp(struct expression *exp, void **result, enum
 }
 
 
+/*
+ * A constant subexpression is calculated the normal way the first
+ * time around (so any error shows up just like it always did), after
+ * which a copy of the remembered value is handed out.
+ */
+PRIVATE void
+exp_folded(struct expression *exp, void **result, enum VAL_TYPE *type)
+{
+    struct exp_folded *f = &exp->e.folded;
+    struct string  *s;
 
-PRIVATE struct {
-    enum optype     type;
-    void            (*func)(struct expression * exp, void **result,
-                            enum VAL_TYPE * type);
-} exptab[] = {
-    {
-     T_EXP_IS_NUM, exp_reexp}, {
-                                T_EXP_IS_STRING, exp_reexp}, {
-                                                              T_ID,
-                                                              exp_id}, {
-                                                                        T_ARRAY,
-                                                                        exp_array},
-    {
-     T_SID, exp_sid}, {
-                       T_SARRAY, exp_array}, {
-                                              T_INTNUM, exp_intnum}, {
-                                                                      T_FLOAT,
-                                                                      exp_float},
-    {
-     T_STRING, exp_string}, {
-                             T_CONST, exp_const}, {
-                                                   T_BINARY, exp_binary}, {
-                                                                           T_UNARY,
-                                                                           exp_unary},
-    {
-     T_SUBSTR, exp_substr}, {
-                             T_SYS, exp_sys}, {
-                                               T_SYSS, exp_syss}, {
-                                                                   T_UNUSED,
-                                                                   0}
-};
+    switch (f->type) {
+    case V_INT:
+        *result = val_int(f->val.num, NULL, type);
+        return;
+
+    case V_FLOAT:
+        *result = val_float(f->val.fnum, NULL, type);
+        return;
+
+    case V_STRING:
+        *result = str_dup(RUN_POOL, f->val.str);
+        *type = V_STRING;
+        return;
+
+    default:
+        break;
+    }
+
+    calc_exp(f->exp, result, type);
+
+    switch (*type) {
+    case V_INT:
+        f->val.num = **(long **) result;
+        break;
+
+    case V_FLOAT:
+        f->val.fnum = **(double **) result;
+        break;
+
+    case V_STRING:
+        s = (struct string *) *result;
+        f->val.str = STR_ALLOC_PRIVATE(mem_poolof(exp), s->len);
+        str_cpy(f->val.str, s);
+        break;
+
+    default:
+        return;
+    }
+
+    f->type = *type;
+}
 
 
 PUBLIC void
 calc_exp(struct expression *exp, void **result, enum VAL_TYPE *type)
 {
-    int             i;
-
     IP(exp, "Calc_exp finds (null) expression");
 
-    for (i = 0; exptab[i].type && exptab[i].type != exp->optype; i++);
+    switch (exp->optype) {
+    case T_EXP_IS_NUM:
+    case T_EXP_IS_STRING:
+        exp_reexp(exp, result, type);
+        break;
 
-    if (exptab[i].type)
-        exptab[i].func(exp, result, type);
-    else
+    case T_ID:
+        exp_id(exp, result, type);
+        break;
+
+    case T_ARRAY:
+    case T_SARRAY:
+        exp_array(exp, result, type);
+        break;
+
+    case T_SID:
+        exp_sid(exp, result, type);
+        break;
+
+    case T_INTNUM:
+        exp_intnum(exp, result, type);
+        break;
+
+    case T_FLOAT:
+        exp_float(exp, result, type);
+        break;
+
+    case T_STRING:
+        exp_string(exp, result, type);
+        break;
+
+    case T_FOLDED:
+        exp_folded(exp, result, type);
+        break;
+
+    case T_CONST:
+        exp_const(exp, result, type);
+        break;
+
+    case T_BINARY:
+        exp_binary(exp, result, type);
+        break;
+
+    case T_BINARY_I:
+        exp_binary_int(exp, result, type);
+        break;
+
+    case T_BINARY_F:
+        exp_binary_float(exp, result, type);
+        break;
+
+    case T_UNARY:
+        exp_unary(exp, result, type);
+        break;
+
+    case T_SUBSTR:
+        exp_substr(exp, result, type);
+        break;
+
+    case T_SYS:
+        exp_sys(exp, result, type);
+        break;
+
+    case T_SYSS:
+        exp_syss(exp, result, type);
+        break;
+
+    default:
         IP(false, "calc_exp, optype does not occur in table");
+    }
 }
 
 
@@ -1328,6 +1718,17 @@ calc_logexp(struct expression *exp)
     void           *result;
     enum VAL_TYPE   type;
     int             log = 0;
+    struct expression *cond = exp;
+
+    /*
+     * IF a<b, WHILE i<=n and the like don't need a result cell 
+     */
+    if (cond->optype == T_EXP_IS_NUM)
+        cond = cond->e.exp;
+
+    if ((cond->optype == T_BINARY_I || cond->optype == T_BINARY_F)
+        && relop(cond->op))
+        return exp_compare(cond);
 
     calc_exp(exp, &result, &type);
 
@@ -42,6 +42,7 @@ is_flag(char *cmd)
     extern bool     show_exec;
     extern bool     short_circuit;
     extern bool     comal_debug;
+    extern bool     batch_output;
 
     if (strcmp(cmd, "debug") == 0)
         return &comal_debug;
@@ -57,6 +58,9 @@ is_flag(char *cmd)
     if (strcmp(cmd, "short_circuit") == 0)
         return &short_circuit;
 
+    if (strcmp(cmd, "batch_output") == 0)
+        return &batch_output;
+
     return NULL;
 }
 
@@ -77,6 +81,20 @@ ext_sys_exp(struct exp_list *exproot, void **result, enum
         *result = cell_alloc(FLOAT_CPOOL);
         sscanf(VERSION, "%lG", *(double **) result);
         *type = V_FLOAT;
+    } else if (strcmp(cmd, "max_depth") == 0) {
+        if (exproot)
+            run_error(SYS_ERR, "SYS(max_depth) takes no parameters");
+
+        *result = cell_alloc(INT_CPOOL);
+        **(long **) result = max_call_depth;
+        *type = V_INT;
+    } else if (strcmp(cmd, "using_compiles") == 0) {
+        if (exproot)
+            run_error(SYS_ERR, "SYS(using_compiles) takes no parameters");
+
+        *result = cell_alloc(INT_CPOOL);
+        **(long **) result = using_compiles;
+        *type = V_INT;
     } else {
         bool           *flag;
 
@@ -266,6 +284,23 @@ ext_sys_stat(struct exp_list *exproot)
             run_error(SYS_ERR, "Error opening sysout: %s",
                       strerror(errno));
 
+        return 0;
+    } else if (strcmp(cmd, "max_depth") == 0) {
+        long            depth;
+
+        if (!exproot->next)
+            run_error(SYS_ERR, "Too few parameters for SYS max_depth");
+
+        if (exproot->next->next)
+            run_error(SYS_ERR, "Too much parameters for SYS max_depth");
+
+        depth = calc_intexp(exproot->next->exp);
+
+        if (depth < 1)
+            run_error(SYS_ERR, "SYS max_depth must be at least 1");
+
+        max_call_depth = depth;
+
         return 0;
 #ifndef NDEBUG
     } else if (strcmp(cmd, "memdump") == 0) {
@@ -282,6 +317,14 @@ ext_sys_stat(struct exp_list *exproot)
 
         sym_list(curenv->curenv, 1);
 
+        return 0;
+    } else if (strcmp(cmd, "flush") == 0) {
+        if (exproot->next) {
+            run_error(SYS_ERR, "No parameters allowed for SYS flush");
+        }
+
+        sys_flush();
+
         return 0;
     } else if (strcmp(cmd, "clrtoeol") == 0) {
         if (exproot->next) {
@@ -86,6 +86,8 @@ free_exp(struct expression *exp)
         break;
 
     case T_BINARY:
+    case T_BINARY_I:
+    case T_BINARY_F:
         free_twoexp(&exp->e.twoexp);
         break;
 
@@ -108,6 +110,14 @@ free_exp(struct expression *exp)
         free_exp(exp->e.exp);
         break;
 
+    case T_FOLDED:
+        free_exp(exp->e.folded.exp);
+
+        if (exp->e.folded.type == V_STRING)
+            mem_free(exp->e.folded.val.str);
+
+        break;
+
     default:
         IP(false, "Free exp default action");
     }
@@ -231,6 +241,9 @@ free_print(struct comal_line *line)
         if (p->modifier->c_using != NULL) {
             free_exp(p->modifier->c_using);
         }
+        if (p->modifier->using_fmt != NULL) {
+            mem_free(p->modifier->using_fmt);
+        }
         mem_free(p->modifier);
     }
 
@@ -295,8 +308,12 @@ free_horse(struct comal_line *line)
     case endmoduleSYM:
         break;
 
-    case execSYM:
     case caseSYM:
+        free_exp(line->lc.caserec.exp);
+        free_casetable(line->lc.caserec.table);
+        break;
+
+    case execSYM:
     case runSYM:
     case delSYM:
     case chdirSYM:
@@ -355,6 +372,8 @@ free_horse(struct comal_line *line)
             if (line->lc.pfrec.external->seg)
                 seg_static_free(line->lc.pfrec.external->seg);
 
+            seg_forget(line);
+
             free_exp(line->lc.pfrec.external->filename);
             mem_free(line->lc.pfrec.external);
         }
@@ -435,6 +454,31 @@ free_horse(struct comal_line *line)
 }
 
 
+PUBLIC void
+free_casetable(struct case_table *table)
+{
+    long            i;
+
+    if (!table)
+        return;
+
+    if (table->dense)
+        mem_free(table->slot);
+    else {
+        for (i = 0; i < table->size; i++) {
+            struct case_entry *work = table->bucket[i];
+
+            while (work)
+                work = (struct case_entry *) mem_free(work);
+        }
+
+        mem_free(table->bucket);
+    }
+
+    mem_free(table);
+}
+
+
 PUBLIC void
 line_free(struct comal_line *line, int mainprog)
 {
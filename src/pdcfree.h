@@ -15,6 +15,9 @@
 #ifndef PDCFREE_H
 #define PDCFREE_H
 
+/** Free the jump table of a CASE statement */
+extern void     free_casetable(struct case_table *table);
+
 /** Free all storage for one line of a program */
 extern void     line_free(struct comal_line *line, int mainprog);
 
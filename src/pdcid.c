@@ -20,7 +20,9 @@
 #include "pdcstr.h"
 #include <string.h>
 
-PRIVATE struct id_rec *id_root = NULL;
+PRIVATE struct id_rec **id_hash = NULL;
+PRIVATE unsigned id_hashsize = 0;
+PRIVATE unsigned id_count = 0;
 
 
 /*
@@ -48,7 +50,7 @@ install(char *idname)
 
     work =
         (struct id_rec *) mem_alloc(MISC_POOL, sizeof(struct id_rec) + l);
-    work->left = work->right = NULL;
+    work->next = NULL;
     term_strncpy(work->name, idname, l + 1);
 
     switch (work->name[l - 1]) {
@@ -66,6 +68,40 @@ install(char *idname)
     return work;
 }
 
+/*
+ * Double the number of hash chains once there are more identifiers than
+ * chains. Identifiers in generated programs may well come in sorted
+ * order, which is why they are no longer kept in a plain binary tree.
+ */
+
+PRIVATE void
+id_grow(void)
+{
+    struct id_rec **old = id_hash;
+    unsigned        oldsize = id_hashsize;
+    struct id_rec  *work;
+    struct id_rec  *next;
+    unsigned        h;
+    unsigned        i;
+
+    id_hashsize = oldsize ? 2 * oldsize : ID_HASHSIZE;
+    id_hash =
+        (struct id_rec **) mem_alloc(MISC_POOL,
+                                     id_hashsize *
+                                     sizeof(struct id_rec *));
+
+    for (i = 0; i < oldsize; i++)
+        for (work = old[i]; work; work = next) {
+            next = work->next;
+            h = name_hash(work->name) & (id_hashsize - 1);
+            work->next = id_hash[h];
+            id_hash[h] = work;
+        }
+
+    if (old)
+        mem_free(old);
+}
+
 /*
  * The next routine does the horse work of searching and installing an
  * identifier. 
@@ -74,38 +110,23 @@ install(char *idname)
 PRIVATE struct id_rec *
 id_horse(char *idname)
 {
-    struct id_rec  *walk = id_root;
-    struct id_rec  *lastone = NULL;
-    struct id_rec  *installed;
-    enum { atroot, overleft, overright } lastchoice = atroot;
-    int             found = 0;
-
-    while (walk != NULL && !found) {
-        int             cmp = strcoll_l(idname, walk->name, latin_loc);
-
-        lastone = walk;
-
-        if (cmp < 0) {
-            lastchoice = overleft;
-            walk = walk->left;
-        } else if (cmp > 0) {
-            lastchoice = overright;
-            walk = walk->right;
-        } else
-            found = 1;
-    }
+    struct id_rec  *walk;
+    unsigned        h;
+
+    if (id_count >= id_hashsize)
+        id_grow();
+
+    h = name_hash(idname) & (id_hashsize - 1);
 
-    if (found)
-        return walk;
+    for (walk = id_hash[h]; walk; walk = walk->next)
+        if (strcmp(idname, walk->name) == 0)
+            return walk;
 
-    installed = install(idname);
+    walk = install(idname);
+    walk->next = id_hash[h];
+    id_count++;
 
-    if (lastchoice == atroot)
-        return (id_root = installed);
-    else if (lastchoice == overleft)
-        return (lastone->left = installed);
-    else
-        return (lastone->right = installed);
+    return (id_hash[h] = walk);
 }
 
 
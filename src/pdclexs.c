@@ -22,6 +22,7 @@
 #include "pdcmisc.h"
 #include "pdcstr.h"
 #include "pdcparss.h"
+#include "pdcval.h"
 
 #include "pdcpars.tab.h"
 
@@ -435,7 +436,7 @@ lex_floatnum(void)
 {
     char           *endptr;
 
-    yylval.dubbel.val = strtod(yytext, &endptr);
+    yylval.dubbel.val = val_strtod(yytext, &endptr);
     yylval.dubbel.text = yytext;
 
     if (*endptr)
@@ -465,18 +466,56 @@ lex_intnum(void)
 }
 
 
+/*
+ * Keywords are looked up in an open addressing hash table over
+ * lexemetab, built on first use. Each slot holds a lexemetab index
+ * plus one, 0 for an empty slot.
+ */
+PRIVATE int     lexemehash[LEXEME_HASHSIZE];
+PRIVATE bool    lexemehash_built = false;
+
+
+PRIVATE void
+lexeme_hashinit(void)
+{
+    unsigned        h;
+    int             i;
+
+    for (i = 0; lexemetab[i].sym; i++) {
+        for (h = name_hash(lexemetab[i].txt) & (LEXEME_HASHSIZE - 1);
+             lexemehash[h]; h = (h + 1) & (LEXEME_HASHSIZE - 1))
+            if (strcmp(lexemetab[lexemehash[h] - 1].txt,
+                       lexemetab[i].txt) == 0)
+                break;
+
+        if (!lexemehash[h])
+            lexemehash[h] = i + 1;
+    }
+
+    lexemehash_built = true;
+}
+
+
 PUBLIC int
 lex_id(int sym)
 {
+    unsigned        h;
     int             i;
 
+    if (!lexemehash_built)
+        lexeme_hashinit();
+
     strupr(yytext);
 
-    for (i = 0; lexemetab[i].sym; i++)
+    for (h = name_hash(yytext) & (LEXEME_HASHSIZE - 1); lexemehash[h];
+         h = (h + 1) & (LEXEME_HASHSIZE - 1)) {
+        i = lexemehash[h] - 1;
+
         if (strcmp(yytext, lexemetab[i].txt) == 0) {
             yylval.inum = lexemetab[i].func;
             return lexemetab[i].sym;
         }
+    }
 
     yylval.id = id_search(yytext);
 
@@ -228,6 +228,8 @@ list_exp(char **buf, struct expression *exp)
         break;
 
     case T_BINARY:
+    case T_BINARY_I:
+    case T_BINARY_F:
         if (exp->op == _RND)
             list_rnd(buf, exp);
         else if (exp->op == _GET)
@@ -283,6 +285,10 @@ list_exp(char **buf, struct expression *exp)
         list_exp(buf, exp->e.exp);
         break;
 
+    case T_FOLDED:
+        list_exp(buf, exp->e.folded.exp);
+        break;
+
     default:
         list_text(buf, "<error: list exp default action>");
     }
@@ -748,7 +754,7 @@ list_horse(char **buf, struct comal_line *line)
 
     case caseSYM:
         list_symsp(buf, line->cmd);
-        list_expsp(buf, line->lc.exp);
+        list_expsp(buf, line->lc.caserec.exp);
         list_sym(buf, ofSYM);
         break;
 
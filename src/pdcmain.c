@@ -117,8 +117,11 @@ main(int argc, char *argv[])
     // curses initialisation.
     latin_to_utf8 = iconv_open("utf8", "latin-9");
 
-    while ((c = getopt(argc, argv, ":dym:")) != -1) {
+    while ((c = getopt(argc, argv, ":bdym:")) != -1) {
         switch (c) {
+        case 'b':
+            sys_headless();
+            break;
         case 'd':
             comal_debug = true;
             break;
@@ -156,7 +159,7 @@ main(int argc, char *argv[])
         Fmt_fprint(stderr,
                    str_ltou(catgets
                             (catdesc, MainSet, MainUsage,
-                             "usage: %s [-dy] [-m <msg-catalog>] ...\n")),
+                             "usage: %s [-bdy] [-m <msg-catalog>] ...\n")),
                    argv[0]);
         RETURN          EXIT_FAILURE;
     }
@@ -69,6 +69,81 @@ cell_init(unsigned pool)
     cell_freepool(pool);
 }
 
+PRIVATE struct mem_arena *
+arena_new(struct mem_pool *pool)
+{
+    struct mem_arena *arena =
+        (struct mem_arena *) CALLOC(1, sizeof(struct mem_arena));
+
+    arena->pool = pool;
+
+    return arena;
+}
+
+/*
+ * Free all arenas that have been shifted into this one
+ */
+PRIVATE void
+arena_freetree(struct mem_arena *arena)
+{
+    struct mem_arena *work;
+    struct mem_arena *next;
+
+    for (work = arena->child; work; work = next) {
+        next = work->sibling;
+        arena_freetree(work);
+        FREE(work);
+    }
+
+    arena->child = NULL;
+}
+
+/*
+ * A block no longer points to this arena. Free the arena once it is an
+ * empty leaf of a shifted tree, and so on upwards
+ */
+PRIVATE void
+arena_drop(struct mem_arena *arena)
+{
+    struct mem_arena *up;
+
+    arena->blocks--;
+
+    while ((up = arena->up) && !arena->blocks && !arena->child) {
+        if (arena->prev)
+            arena->prev->sibling = arena->sibling;
+        else
+            up->child = arena->sibling;
+
+        if (arena->sibling)
+            arena->sibling->prev = arena->prev;
+
+        FREE(arena);
+        arena = up;
+    }
+}
+
+/*
+ * Find the pool a block belongs to, and let the block point straight to
+ * the top arena from now on
+ */
+PRIVATE struct mem_pool *
+block_pool(struct mem_block *memblock)
+{
+    struct mem_arena *arena = memblock->arena;
+
+    while (arena->up)
+        arena = arena->up;
+
+    if (arena != memblock->arena) {
+        arena->blocks++;
+        arena_drop(memblock->arena);
+        memblock->arena = arena;
+    }
+
+    return arena->pool;
+}
+
 PRIVATE void
 pool_init(struct mem_pool *pool)
 {
@@ -78,6 +153,8 @@ pool_init(struct mem_pool *pool)
     pool->size = 0;
 #endif
     pool->root = NULL;
+    pool->tail = NULL;
+    pool->arena = arena_new(pool);
 }
 
 PUBLIC void
@@ -163,7 +240,8 @@ mem_alloc_private(struct mem_pool *pool, size_t size)
     p = (struct mem_block *) CALLOC(1, size + sizeof(struct mem_block));
 
     p->marker = MEM_MARKER;
-    p->pool = pool;
+    p->arena = pool->arena;
+    p->arena->blocks++;
     p->next = pool->root;
     p->prev = NULL;
 #ifndef NDEBUG
@@ -174,6 +252,8 @@ mem_alloc_private(struct mem_pool *pool, size_t size)
 
     if (p->next)
         p->next->prev = p;
+    else
+        pool->tail = p;
 
     DBG_PRINTF(true, " at %p", p);
 
@@ -194,17 +274,19 @@ mem_realloc(void *block, long newsize)
                                         __FILE__, __LINE__);
 
 #ifndef NDEBUG
-    memblock->pool->size += newsize - memblock->size;
+    block_pool(memblock)->size += newsize - memblock->size;
     memblock->size = newsize;
 #endif
 
     if (memblock->next)
         memblock->next->prev = memblock;
+    else
+        block_pool(memblock)->tail = memblock;
 
     if (memblock->prev)
         memblock->prev->next = memblock;
     else
-        memblock->pool->root = memblock;
+        block_pool(memblock)->root = memblock;
 
     return ++memblock;
 }
@@ -242,25 +324,30 @@ mem_free(void *m)
 
     struct mem_block *memblock = (struct mem_block *) m;
     void           *result = ((struct my_list *) m)->next;
+    struct mem_pool *pool;
 
     --memblock;
 
-    DBG_PRINTF(true, "Memfree block at %p (pool %d)",
-               memblock, memblock->pool->id);
-
     IP(memblock->marker == MEM_MARKER, "Invalid marker in mem_free()");
 
+    pool = block_pool(memblock);
+
+    DBG_PRINTF(true, "Memfree block at %p (pool %d)", memblock, pool->id);
+
     if (memblock->next)
         memblock->next->prev = memblock->prev;
+    else
+        pool->tail = memblock->prev;
 
     if (memblock->prev)
         memblock->prev->next = memblock->next;
     else
-        memblock->pool->root = memblock->next;
+        pool->root = memblock->next;
 
 #ifndef NDEBUG
-    memblock->pool->size -= memblock->size;
+    pool->size -= memblock->size;
 #endif
+    memblock->arena->blocks--;
     FREE(memblock);
 
     return result;
@@ -315,6 +402,9 @@ mem_freepool_private(struct mem_pool *pool)
     }
 
     pool->root = NULL;
+    pool->tail = NULL;
+    arena_freetree(pool->arena);
+    pool->arena->blocks = 0;
 #ifndef NDEBUG
     pool->size = 0;
 #endif
@@ -327,34 +417,50 @@ mem_freepool_private(struct mem_pool *pool)
 
 
 PUBLIC void
-mem_shiftmem(unsigned _frompool, struct mem_pool *topool)
+mem_shiftmem(unsigned frompool, struct mem_pool *topool)
+{
+    IP(frompool < NR_FIXED_POOLS, "Invalid pool number in mem_shiftmem()");
+
+    mem_shiftmem_private(&mem_pool[frompool], topool);
+}
+
+PUBLIC void
+mem_shiftmem_private(struct mem_pool *frompool, struct mem_pool *topool)
 {
-    struct mem_pool *frompool = &mem_pool[_frompool];
-    struct mem_block *work = frompool->root;
+    struct mem_arena *arena = frompool->arena;
 
     DBG_PRINTF(true,
                "Shift mem from pool %d to pool %d",
                frompool->id, topool->id);
 
-    if (!work)
+    if (!frompool->root)
         return;
 
-    while (work->next) {
-        work->pool = topool;
-        work = work->next;
-    }
+    frompool->tail->next = topool->root;
+
+    if (topool->root)
+        topool->root->prev = frompool->tail;
+    else
+        topool->tail = frompool->tail;
 
-    work->pool = topool;
-    work->next = topool->root;
     topool->root = frompool->root;
     frompool->root = NULL;
+    frompool->tail = NULL;
 #ifndef NDEBUG
     topool->size += frompool->size;
     frompool->size = 0;
 #endif
 
-    if (work->next)
-        work->next->prev = work;
+    arena->pool = NULL;
+    arena->up = topool->arena;
+    arena->sibling = topool->arena->child;
+    arena->prev = NULL;
+
+    if (arena->sibling)
+        arena->sibling->prev = arena;
+
+    topool->arena->child = arena;
+    frompool->arena = arena_new(frompool);
 }
 
 #ifndef NDEBUG
@@ -368,6 +474,19 @@ mem_debug(void)
 }
 #endif
 
+PUBLIC struct mem_pool *
+mem_poolof(void *m)
+{
+    struct mem_block *memblock = (struct mem_block *) m;
+
+    --memblock;
+
+    IP(memblock->marker == MEM_MARKER, "Invalid marker in mem_poolof()");
+
+    return block_pool(memblock);
+}
+
+
 PUBLIC struct mem_pool *
 pool_new(void)
 {
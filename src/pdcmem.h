@@ -39,7 +39,23 @@ struct mem_block {
 #ifndef NDEBUG
     long            size;
 #endif
-    struct mem_pool *pool;
+    struct mem_arena *arena;
+};
+
+/**
+ * Ownership of memory blocks. New blocks of a pool point to its current
+ * arena; shifting a pool into another one hangs that arena below the
+ * current arena of the other pool, so that its blocks need not be
+ * touched. A shifted arena is freed again once no block points to it
+ * and no arena hangs below it.
+ */
+struct mem_arena {
+    struct mem_pool *pool;      /**< Owning pool, of a top arena only */
+    struct mem_arena *up;       /**< Arena this one was shifted into */
+    struct mem_arena *child;    /**< First arena shifted into this one */
+    struct mem_arena *sibling;  /**< Next arena shifted into the same one */
+    struct mem_arena *prev;     /**< Previous arena shifted into the same one */
+    long            blocks;     /**< Number of blocks pointing to this one */
 };
 
 /** A pool of related allocated memory blocks */
@@ -48,6 +64,8 @@ struct mem_pool {
     long            size;
 #endif
     struct mem_block *root;
+    struct mem_block *tail;
+    struct mem_arena *arena;
     int             id;
 };
 
@@ -93,15 +111,25 @@ extern void     mem_freepool(unsigned int pool);
  */
 extern void     mem_freepool_private(struct mem_pool *pool);
 
-/** Move a memory block from one pool to another */
+/** Move all memory blocks from one pool to another, in constant time */
 extern void     mem_shiftmem(unsigned int frompool,
                              struct mem_pool *topool);
 
+/**
+ * Private interface to move all memory blocks from one pool to another.
+ * @see prog_splice
+ */
+extern void     mem_shiftmem_private(struct mem_pool *frompool,
+                                     struct mem_pool *topool);
+
 #ifndef NDEBUG
 /** Print the size of all pools */
 extern void     mem_debug(void);
 #endif
 
+/** Find the pool that a memory block was allocated in */
+extern struct mem_pool *mem_poolof(void *m);
+
 /** Allocate a new memory pool */
 extern struct mem_pool *pool_new(void);
 
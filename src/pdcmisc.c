@@ -22,6 +22,7 @@
 #include "pdcsys.h"
 #include "pdcexec.h"
 #include "pdclist.h"
+#include "pdcprog.h"
 #include "msgnrs.h"
 #include "pdcmisc.h"
 
@@ -33,15 +34,18 @@
 
 #include "fmt.h"
 
+/*
+ * Output to the SELECT OUTPUT file (or the file of PRINT FILE) goes into
+ * its stdio buffer without checking every fragment: a write error stays
+ * in ferror() and is reported once the statement is done, by
+ * my_outcheck() or the caller of print_file().
+ */
 PUBLIC void
 my_nl(int stream)
 {
-    if (sel_outfile && stream == MSG_PROGRAM) {
-        if (fputc('\n', sel_outfile) == EOF)
-            run_error(SELECT_ERR,
-                      "Error when writing to SELECT OUTPUT file %s",
-                      strerror(errno));
-    } else
+    if (sel_outfile && stream == MSG_PROGRAM)
+        putc('\n', sel_outfile);
+    else
         sys_nl();
 }
 
@@ -49,12 +53,9 @@ my_nl(int stream)
 PUBLIC void
 my_ht(int stream)
 {
-    if (sel_outfile && stream == MSG_PROGRAM) {
-        if (fputc('\t', sel_outfile) == EOF)
-            run_error(SELECT_ERR,
-                      "Error when writing to SELECT OUTPUT file %s",
-                      strerror(errno));
-    } else
+    if (sel_outfile && stream == MSG_PROGRAM)
+        putc('\t', sel_outfile);
+    else
         sys_ht();
 }
 
@@ -63,15 +64,27 @@ PUBLIC void
 my_put(int stream, const char *buf, long len)
 {
     if (sel_outfile && stream == MSG_PROGRAM) {
-        if (fputs(buf, sel_outfile) == EOF)
-            run_error(SELECT_ERR,
-                      "Error when writing to SELECT OUTPUT file %s",
-                      strerror(errno));
+        if (len < 0)
+            len = strlen(buf);
+
+        fwrite(buf, 1, len, sel_outfile);
     } else
         sys_put(stream, buf, len);
 }
 
 
+PUBLIC void
+my_outcheck(void)
+{
+    if (sel_outfile && ferror(sel_outfile)) {
+        clearerr(sel_outfile);
+        run_error(SELECT_ERR,
+                  "Error when writing to SELECT OUTPUT file %s",
+                  strerror(errno));
+    }
+}
+
+
 PUBLIC void
 my_printf(int stream, bool newline, const char *s, ...)
 {
@@ -268,6 +281,252 @@ exp_of_id(struct expression *exp)
     return id;
 }
 
+/*
+ * Is this expression a constant? A unary plus/minus or parentheses
+ * around a constant count as one, but are not worth folding themselves.
+ */
+PRIVATE bool
+exp_constant(struct expression *exp)
+{
+    if (!exp)
+        return false;
+
+    switch (exp->optype) {
+    case T_INTNUM:
+    case T_FLOAT:
+    case T_STRING:
+    case T_FOLDED:
+        return true;
+
+    case T_CONST:
+        return exp->op == _PI || exp->op == _TRUE || exp->op == _FALSE;
+
+    case T_UNARY:
+        return (exp->op == lparenSYM || exp->op == plusSYM
+                || exp->op == minusSYM) && exp_constant(exp->e.exp);
+
+    default:
+        return false;
+    }
+}
+
+
+PUBLIC bool
+exp_foldable(struct expression *exp)
+{
+    if (exp->optype == T_BINARY)
+        return exp->op != _RND && exp->op != _GET
+            && exp_constant(exp->e.twoexp.exp1)
+            && exp_constant(exp->e.twoexp.exp2);
+
+    if (exp->optype != T_UNARY)
+        return false;
+
+    switch (exp->op) {
+    case _CHR:
+    case _SPC:
+    case _ORD:
+    case _LOWER:
+    case _UPPER:
+    case _LEN:
+    case _SGN:
+    case _NOT:
+    case _RAD:
+    case _DEG:
+    case _FRAC:
+    case _ROUND:
+    case _ABS:
+    case _ACS:
+    case _ASN:
+    case _ATN:
+    case _COS:
+    case _EXP:
+    case _INT:
+    case _LOG:
+    case _LOG10:
+    case _SIN:
+    case _SQR:
+    case _TAN:
+        return exp_constant(exp->e.exp);
+
+    default:
+        return false;
+    }
+}
+
+
+/*
+ * The numeric type an expression will normally have, going by the
+ * types of its identifiers and operators. V_ERROR if this can not be
+ * told in advance (like integer + integer, which may overflow into a
+ * float).
+ */
+PRIVATE enum VAL_TYPE
+exp_numtype(struct expression *exp)
+{
+    enum VAL_TYPE   t1,
+                    t2;
+
+    if (!exp)
+        return V_ERROR;
+
+    switch (exp->optype) {
+    case T_INTNUM:
+        return V_INT;
+
+    case T_FLOAT:
+        return V_FLOAT;
+
+    case T_CONST:
+        switch (exp->op) {
+        case _PI:
+            return V_FLOAT;
+
+        case _ERRTEXT:
+        case _DIR:
+        case _UNIT:
+        case _KEY:
+            return V_ERROR;
+
+        default:
+            return V_INT;
+        }
+
+    case T_ID:
+        if (exp->e.expid.id->type == V_STRING)
+            return V_ERROR;
+
+        return exp->e.expid.id->type;
+
+    case T_FOLDED:
+        return exp_numtype(exp->e.folded.exp);
+
+    case T_EXP_IS_NUM:
+        return exp_numtype(exp->e.exp);
+
+    case T_UNARY:
+        switch (exp->op) {
+        case lparenSYM:
+        case plusSYM:
+        case minusSYM:
+            return exp_numtype(exp->e.exp);
+
+        case _LEN:
+        case _ORD:
+            return V_INT;
+
+        case _RAD:
+        case _DEG:
+        case _FRAC:
+        case _ROUND:
+        case _ABS:
+        case _ACS:
+        case _ASN:
+        case _ATN:
+        case _COS:
+        case _EXP:
+        case _INT:
+        case _LOG:
+        case _LOG10:
+        case _SIN:
+        case _SQR:
+        case _TAN:
+            return V_FLOAT;
+
+        default:
+            return V_ERROR;
+        }
+
+    case T_BINARY:
+    case T_BINARY_I:
+    case T_BINARY_F:
+        switch (exp->op) {
+        case eqlSYM:
+        case neqSYM:
+        case lssSYM:
+        case gtrSYM:
+        case leqSYM:
+        case geqSYM:
+        case andSYM:
+        case andthenSYM:
+        case orSYM:
+        case orthenSYM:
+        case eorSYM:
+        case inSYM:
+            return V_INT;
+
+        case plusSYM:
+        case minusSYM:
+        case timesSYM:
+        case divideSYM:
+        case powerSYM:
+        case divSYM:
+        case modSYM:
+            t1 = exp_numtype(exp->e.twoexp.exp1);
+            t2 = exp_numtype(exp->e.twoexp.exp2);
+
+            if (t1 == V_ERROR || t2 == V_ERROR)
+                return V_ERROR;
+
+            if (t1 == V_FLOAT || t2 == V_FLOAT || exp->op == powerSYM)
+                return V_FLOAT;
+
+            if (exp->op == divSYM || exp->op == modSYM)
+                return V_INT;
+
+            return V_ERROR;
+
+        default:
+            return V_ERROR;
+        }
+
+    default:
+        return V_ERROR;
+    }
+}
+
+
+PUBLIC void
+exp_typed(struct expression *exp)
+{
+    enum VAL_TYPE   t1,
+                    t2;
+
+    if (exp->optype != T_BINARY)
+        return;
+
+    t1 = exp_numtype(exp->e.twoexp.exp1);
+    t2 = exp_numtype(exp->e.twoexp.exp2);
+
+    if (t1 == V_ERROR || t2 == V_ERROR)
+        return;
+
+    switch (exp->op) {
+    case plusSYM:
+    case minusSYM:
+    case timesSYM:
+    case divideSYM:
+    case powerSYM:
+    case eqlSYM:
+    case neqSYM:
+    case lssSYM:
+    case gtrSYM:
+    case leqSYM:
+    case geqSYM:
+        break;
+
+    default:
+        return;
+    }
+
+    if (t1 == V_INT && t2 == V_INT) {
+        if (exp->op != powerSYM)
+            exp->optype = T_BINARY_I;
+    } else
+        exp->optype = T_BINARY_F;
+}
+
+
 PUBLIC bool
 exp_of_string(struct expression *exp)
 {
@@ -290,12 +549,11 @@ exp_cmd(struct expression *exp)
 PUBLIC struct comal_line *
 search_line(long l, int exact)
 {
-    struct comal_line *work = curenv->progroot;
+    struct comal_line *work;
 
     DBG_PRINTF(true, "Searching line %D", l);
 
-    while (work && work->ld->lineno < l)
-        work = work->ld->next;
+    work = prog_find_line(l);
 
     if (!work)
         return NULL;
@@ -395,7 +653,7 @@ PRIVATE struct {
     , {
        exitSYM, sizeof(c_line.lc.exp)}
     , {
-       caseSYM, sizeof(c_line.lc.exp)}
+       caseSYM, sizeof(c_line.lc.caserec)}
     , {
        chdirSYM, sizeof(c_line.lc.exp)}
     , {
@@ -651,6 +909,21 @@ strlwr(char *s)
     }
 }
 
+/*
+ * Names are compared with strcmp(), so unlike str_hash() this need not
+ * look at the collation of the locale
+ */
+PUBLIC unsigned
+name_hash(const char *s)
+{
+    unsigned        h = 0;
+
+    while (*s)
+        h = h * 31 + (unsigned char) *s++;
+
+    return h;
+}
+
 PUBLIC char    *
 ltoa(long num, char *buf)
 {
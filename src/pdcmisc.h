@@ -29,6 +29,9 @@ extern void     my_put(int stream, const char *buf, long len);
 /** Write a formatted string to the specified stream */
 extern void     my_printf(int stream, bool newline, const char *s, ...);
 
+/** Report a held back write error of the SELECT OUTPUT file */
+extern void     my_outcheck(void);
+
 /** Optionally print a debug message */
 #define DBG_PRINTF(...) VLG((comal_debug, __VA_ARGS__))
 
@@ -74,6 +77,19 @@ extern int      type_match1(struct id_rec *id, struct expression *exp);
 /** Get the identifier out of an expression */
 extern struct id_rec *exp_of_id(struct expression *exp);
 
+/**
+ * Test if an expression only combines constants with operators and
+ * functions that have no side effects, so its value never changes
+ */
+extern bool     exp_foldable(struct expression *exp);
+
+/**
+ * Turn a T_BINARY expression into a T_BINARY_I or T_BINARY_F if its
+ * operands are known to be numbers of one type (or of mixed type, for
+ * T_BINARY_F)
+ */
+extern void     exp_typed(struct expression *exp);
+
 /** Test if an expression is a string or not */
 extern bool     exp_of_string(struct expression *exp);
 
@@ -115,6 +131,9 @@ extern struct comal_line *stat_dup(struct comal_line *stat);
 /** Convert a long to a string in base 10 */
 extern char    *ltoa(long num, char *buf);
 
+/** Hash a keyword or identifier name byte by byte (see str_hash()) */
+extern unsigned name_hash(const char *s);
+
 #ifndef HAS_STRLWR
 
 /** Convert a string to upper case in-place, for the current locale */
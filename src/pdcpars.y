@@ -645,7 +645,8 @@ export_stat	:	exportSYM idlist
 case_stat	:	caseSYM exp optof
 			{
 				$$.cmd=caseSYM;
-				$$.lc.exp=$2;
+				$$.lc.caserec.exp=$2;
+				$$.lc.caserec.table=NULL;
 			}
 		;
 		
@@ -152,6 +152,21 @@ pars_exp_const(int op)
     return work;
 }
 
+/*
+ * Wrap a constant subexpression in a T_FOLDED node, so it only gets
+ * calculated once
+ */
+PRIVATE struct expression *
+pars_exp_fold(struct expression *exp)
+{
+    GETEXP(sizeof(struct exp_folded));
+
+    work->optype = T_FOLDED;
+    work->e.folded.exp = exp;
+
+    return work;
+}
+
 PUBLIC struct expression *
 pars_exp_unary(int op, struct expression *exp)
 {
@@ -165,6 +180,9 @@ pars_exp_unary(int op, struct expression *exp)
     if (exp && ISARRAY(exp))
         pars_error("Arrays may not be part of an expression");
 
+    if (exp_foldable(work))
+        return pars_exp_fold(work);
+
     return work;
 }
 
@@ -196,6 +214,11 @@ pars_exp_binary(int op, struct expression *exp1, struct expression *exp2)
     if (ISARRAY(exp1) || ISARRAY(exp2))
         pars_error("Arrays may not be part of an expression");
 
+    if (exp_foldable(work))
+        return pars_exp_fold(work);
+
+    exp_typed(work);
+
     return work;
 }
 
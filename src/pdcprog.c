@@ -25,24 +25,172 @@
 #include "pdcenv.h"
 #include "pdcexec.h"
 #include "pdcmod.h"
+#include <limits.h>
 
 
-PUBLIC void
-prog_addline(struct comal_line *line)
+/*
+ * Besides the linked list from progroot, the lines of the program are
+ * kept in a skip list (curenv->lineindex), so that a line is found by
+ * its number without walking the program. Level 0 links all lines in
+ * order; a node is on each next level with a chance of 1 in 4. The
+ * nodes live in the program pool, just like the lines.
+ */
+PRIVATE unsigned index_seed = 2463534242U;
+
+
+PRIVATE int
+index_height(void)
 {
-    struct comal_line *work = curenv->progroot;
-    struct comal_line *last = NULL;
-    int             scan = 0;
+    unsigned        r;
+    int             height = 1;
 
-    while (work && work->ld->lineno < line->ld->lineno) {
-        last = work;
-        work = work->ld->next;
+    index_seed ^= index_seed << 13;
+    index_seed ^= index_seed >> 17;
+    index_seed ^= index_seed << 5;
+
+    for (r = index_seed; (r & 3) == 0 && height < LINE_INDEX_LEVELS;
+         r >>= 2)
+        height++;
+
+    return height;
+}
+
+
+PRIVATE struct line_node *
+index_node(struct comal_line *line)
+{
+    int             height = index_height();
+    struct line_node *node;
+
+    node = (struct line_node *) mem_alloc_private(curenv->program_pool,
+                                                  sizeof(struct line_node)
+                                                  +
+                                                  height *
+                                                  sizeof(struct line_node
+                                                         *));
+    node->line = line;
+    node->height = height;
+
+    return node;
+}
+
+
+/*
+ * Find the links to the first node numbered lineno or higher on every
+ * level, and return the node before it (NULL if there is none)
+ */
+PRIVATE struct line_node *
+index_find(long lineno, struct line_node **link[])
+{
+    struct line_node *prev = NULL;
+    struct line_node **walk;
+    int             i;
+
+    for (i = LINE_INDEX_LEVELS - 1; i >= 0; i--) {
+        walk = prev ? &prev->next[i] : &curenv->lineindex[i];
+
+        while (*walk && (*walk)->line->ld->lineno < lineno) {
+            prev = *walk;
+            walk = &prev->next[i];
+        }
+
+        link[i] = walk;
+    }
+
+    return prev;
+}
+
+
+PRIVATE void
+index_add(struct line_node **link[], struct comal_line *line)
+{
+    struct line_node *node = index_node(line);
+    int             i;
+
+    for (i = 0; i < node->height; i++) {
+        node->next[i] = *link[i];
+        *link[i] = node;
     }
+}
+
+
+/*
+ * Remove the node the links found by index_find() point to
+ */
+PRIVATE void
+index_remove(struct line_node **link[])
+{
+    struct line_node *node = *link[0];
+    int             i;
+
+    for (i = 0; i < node->height; i++)
+        *link[i] = node->next[i];
+
+    mem_free(node);
+}
+
+
+/*
+ * Index the whole program at once, after it has been LOADed or after
+ * a batch of ENTERed lines has been spliced in
+ */
+PRIVATE void
+index_build(void)
+{
+    struct line_node **link[LINE_INDEX_LEVELS];
+    struct line_node *node;
+    struct line_node *next;
+    struct comal_line *line;
+    int             i;
+
+    for (node = curenv->lineindex[0]; node; node = next) {
+        next = node->next[0];
+        mem_free(node);
+    }
+
+    for (i = 0; i < LINE_INDEX_LEVELS; i++) {
+        curenv->lineindex[i] = NULL;
+        link[i] = &curenv->lineindex[i];
+    }
+
+    for (line = curenv->progroot; line; line = line->ld->next) {
+        node = index_node(line);
+
+        for (i = 0; i < node->height; i++) {
+            *link[i] = node;
+            link[i] = &node->next[i];
+        }
+    }
+}
+
+
+PUBLIC struct comal_line *
+prog_find_line(long l)
+{
+    struct line_node **link[LINE_INDEX_LEVELS];
 
-    if (!work || work->ld->lineno > line->ld->lineno)
+    index_find(l, link);
+
+    return *link[0] ? (*link[0])->line : NULL;
+}
+
+
+PUBLIC void
+prog_addline(struct comal_line *line)
+{
+    struct line_node **link[LINE_INDEX_LEVELS];
+    struct line_node *prev = index_find(line->ld->lineno, link);
+    struct line_node *node = *link[0];
+    struct comal_line *work = node ? node->line : NULL;
+    struct comal_line *last = prev ? prev->line : NULL;
+    bool            scan = false;
+
+    if (!work || work->ld->lineno > line->ld->lineno) {
         line->ld->next = work;
-    else {
+        index_add(link, line);
+    } else {
         line->ld->next = work->ld->next;
+        node->line = line;
         scan = assess_scan(work);
         line_free(work, 1);
     }
@@ -59,11 +207,152 @@ prog_addline(struct comal_line *line)
 
     curenv->changed = true;
 
-    if (!scan)
-        scan = assess_scan(line);
+    if (assess_scan(line))
+        scan = true;
 
     if (scan)
-        prog_structure_scan();
+        prog_structure_rescan(last);
+}
+
+
+/*
+ * Program lines read by ENTER are not linked in one by one, but staged:
+ * their parse memory is moved to a pool of its own and the lines are
+ * kept in a list in the order they were read. prog_splice() then sorts
+ * that list once, merges it with the program in a single walk and
+ * hands the whole staging pool over to the program pool.
+ */
+PRIVATE struct mem_pool *stage_pool = NULL;
+PRIVATE struct comal_line *stage_root = NULL;
+PRIVATE struct comal_line *stage_last = NULL;
+PRIVATE long    stage_count = 0;
+PRIVATE bool    stage_sorted = true;
+
+
+PUBLIC void
+prog_stageline(struct comal_line *line)
+{
+    if (!stage_pool)
+        stage_pool = pool_new();
+
+    mem_shiftmem(PARSE_POOL, stage_pool);
+    line->ld->next = NULL;
+
+    if (stage_last) {
+        if (line->ld->lineno < stage_last->ld->lineno)
+            stage_sorted = false;
+
+        stage_last->ld->next = line;
+    } else
+        stage_root = line;
+
+    stage_last = line;
+    stage_count++;
+}
+
+
+/*
+ * Merge sort the first n lines of a list on line number. Lines with the
+ * same number keep the order in which they were read.
+ */
+PRIVATE struct comal_line *
+stage_sort(struct comal_line *list, long n)
+{
+    struct comal_line *result = NULL;
+    struct comal_line **tail = &result;
+    struct comal_line *right;
+    struct comal_line *work = list;
+    long            i;
+
+    if (n < 2)
+        return list;
+
+    for (i = 1; i < n / 2; i++)
+        work = work->ld->next;
+
+    right = work->ld->next;
+    work->ld->next = NULL;
+    list = stage_sort(list, n / 2);
+    right = stage_sort(right, n - n / 2);
+
+    while (list && right) {
+        if (right->ld->lineno < list->ld->lineno) {
+            *tail = right;
+            right = right->ld->next;
+        } else {
+            *tail = list;
+            list = list->ld->next;
+        }
+
+        tail = &(*tail)->ld->next;
+    }
+
+    *tail = list ? list : right;
+
+    return result;
+}
+
+
+PUBLIC void
+prog_splice(void)
+{
+    struct comal_line *line = stage_root;
+    struct comal_line *work = curenv->progroot;
+    struct comal_line *last = NULL;
+    struct comal_line *next;
+
+    if (!line)
+        return;
+
+    if (!stage_sorted)
+        line = stage_sort(line, stage_count);
+
+    stage_root = stage_last = NULL;
+    stage_count = 0;
+    stage_sorted = true;
+
+    while (line) {
+        next = line->ld->next;
+
+        if (next && next->ld->lineno == line->ld->lineno) {
+            line_free(line, 1);
+            line = next;
+            continue;
+        }
+
+        while (work && work->ld->lineno < line->ld->lineno) {
+            last = work;
+            work = work->ld->next;
+        }
+
+        if (work && work->ld->lineno == line->ld->lineno) {
+            struct comal_line *old = work;
+
+            work = work->ld->next;
+            assess_scan(old);
+            line_free(old, 1);
+        }
+
+        line->ld->next = work;
+
+        if (last) {
+            last->ld->next = line;
+
+            if (scan_necessary(last) == STRUCTURE_START)
+                line->ld->indent = last->ld->indent + INDENTION;
+            else
+                line->ld->indent = last->ld->indent;
+        } else
+            curenv->progroot = line;
+
+        assess_scan(line);
+        last = line;
+        line = next;
+    }
+
+    mem_shiftmem_private(stage_pool, curenv->program_pool);
+    index_build();
+    curenv->changed = true;
 }
 
 
@@ -71,21 +360,32 @@ PUBLIC int
 prog_del(struct comal_line **root, long from, long to, int
          mainprog)
 {
+    struct line_node **link[LINE_INDEX_LEVELS];
+    struct line_node *prev;
     struct comal_line *work = *root;
     struct comal_line *last = NULL;
     struct comal_line *next;
     int             scan = 0;
 
-    while (work && work->ld->lineno < from) {
-        last = work;
-        work = work->ld->next;
-    }
+    if (mainprog) {
+        prev = index_find(from, link);
+        last = prev ? prev->line : NULL;
+        work = *link[0] ? (*link[0])->line : NULL;
+    } else
+        while (work && work->ld->lineno < from) {
+            last = work;
+            work = work->ld->next;
+        }
 
     while (work && work->ld->lineno <= to) {
         next = work->ld->next;
 
-        if (!scan)
-            scan = assess_scan(work);
+        if (mainprog) {
+            if (assess_scan(work))
+                scan = 1;
+
+            index_remove(link);
+        }
 
         line_free(work, mainprog);
         work = next;
@@ -96,6 +396,9 @@ prog_del(struct comal_line **root, long from, long to, int
     else
         *root = work;
 
+    if (scan && mainprog)
+        prog_structure_rescan(last);
+
     return scan;
 }
 
@@ -103,18 +406,10 @@ prog_del(struct comal_line **root, long from, long to, int
 PUBLIC long
 prog_highest_line(void)
 {
-    struct comal_line *work = curenv->progroot;
-    struct comal_line *last = NULL;
-
-    if (!work)
-        return 0L;
-
-    while (work) {
-        last = work;
-        work = work->ld->next;
-    }
+    struct line_node **link[LINE_INDEX_LEVELS];
+    struct line_node *last = index_find(LONG_MAX, link);
 
-    return last->ld->lineno;
+    return last ? last->line->ld->lineno : 0L;
 }
 
 PUBLIC void
@@ -125,7 +420,7 @@ prog_total_scan(void)
 
     DBG_PRINTF(true, "Total scanning...");
 
-    curenv->scan_ok = scan_scan(NULL, errtxt, &errline);
+    curenv->scan_ok = scan_update(errtxt, &errline);
 
     if (!curenv->scan_ok) {
         if (errline)
@@ -145,12 +440,13 @@ prog_new(void)
 
 
 PUBLIC void
-prog_load(char *fn)
+prog_load(char *fn, struct sqash_links *links)
 {
     DBG_PRINTF(true, "LOADing %s", fn);
 
     prog_new();
-    curenv->progroot = expand_fromfile(fn);
+    curenv->progroot = expand_fromfile(fn, links);
+    index_build();
     curenv->changed = false;
 }
 
@@ -158,13 +454,21 @@ prog_load(char *fn)
 PUBLIC void
 prog_run(void)
 {
+    struct sqash_links links;
+
     clean_runenv(curenv);
+    links.linked = false;
 
     if (runfilename) {
-        prog_load(runfilename);
+        prog_load(runfilename, &links);
         prog_structure_scan();
         mem_free(runfilename);
         runfilename = NULL;
+
+        if (links.linked) {
+            curenv->globalproc = links.globalproc;
+            curenv->scan_ok = true;
+        }
     }
 
     curenv->curenv = ROOTENV();
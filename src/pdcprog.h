@@ -18,6 +18,12 @@
 /** Add a line to the current program, SCANning where necessary */
 extern void     prog_addline(struct comal_line *line);
 
+/** Stage a line read by ENTER, to be added by prog_splice() */
+extern void     prog_stageline(struct comal_line *line);
+
+/** Add all staged lines to the current program in one go */
+extern void     prog_splice(void);
+
 /**
  * Delete a line from the current program.
  * This implements the DEL command.
@@ -25,6 +31,9 @@ extern void     prog_addline(struct comal_line *line);
 extern int      prog_del(struct comal_line **root, long from, long to,
                          int mainprog);
 
+/** Returns the first program line numbered @c l or higher, or NULL */
+extern struct comal_line *prog_find_line(long l);
+
 /** Returns the current highest line number */
 extern long     prog_highest_line(void);
 
@@ -37,8 +46,9 @@ extern void     prog_new(void);
 /**
  * Load a tokenized program from disk.
  * The current program is replaced.
+ * links (if not NULL) gets the structure links of an image.
  */
-extern void     prog_load(char *fn);
+extern void     prog_load(char *fn, struct sqash_links *links);
 
 /** Run the current program, or another one stored in a file */
 extern void     prog_run(void);
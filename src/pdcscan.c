@@ -25,6 +25,7 @@
 #include "msgnrs.h"
 #include "pdcscan.h"
 #include "pdcstr.h"
+#include "pdcfree.h"
 
 #include <string.h>
 
@@ -189,6 +190,253 @@ routine_search(struct id_rec *id, int type, struct comal_line *curproc)
 }
 
 
+/*
+ * Find out whether a RETURN or EXEC line calls its own PROC/FUNC in
+ * tail position. If so, the PROC/FUNC line is returned, to be stored
+ * in the line's lineptr for exec_call() to reuse the current frame.
+ */
+PRIVATE struct comal_line *
+scan_tailcall(struct comal_line *curline, struct comal_line *theline,
+              struct comal_line *procline)
+{
+    struct expression *exp = theline->lc.exp;
+    struct parm_list *pwalk;
+    struct comal_line *next;
+
+    if (!procline || !exp)
+        return NULL;
+
+    if (exp->optype == T_EXP_IS_NUM || exp->optype == T_EXP_IS_STRING)
+        exp = exp->e.exp;
+
+    if (exp->optype == T_SID) {
+        if (exp->e.expsid.twoexp)
+            return NULL;
+    } else if (exp->optype != T_ID)
+        return NULL;
+
+    if (exp->e.expid.id != procline->lc.pfrec.id)
+        return NULL;
+
+    /*
+     * REF, NAME and PROC/FUNC parameters may refer to the very frame
+     * that is about to be discarded
+     */
+    for (pwalk = procline->lc.pfrec.parmroot; pwalk; pwalk = pwalk->next)
+        if (pwalk->ref)
+            return NULL;
+
+    if (theline->cmd == returnSYM)
+        return procline->cmd == funcSYM ? procline : NULL;
+
+    if (procline->cmd != procSYM)
+        return NULL;
+
+    /*
+     * An EXEC is in tail position if only an ENDPROC or a plain RETURN
+     * follows it (also when it is the short form of an IF)
+     */
+    if (theline != curline && curline->cmd != ifSYM)
+        return NULL;
+
+    next = curline->ld->next;
+
+    while (next && next->cmd == 0)
+        next = next->ld->next;
+
+    if (next == procline->lineptr
+        || (next && next->cmd == returnSYM && !next->lc.exp))
+        return procline;
+
+    return NULL;
+}
+
+
+/*
+ * Get the key of a WHEN alternative for the CASE jump table. Only
+ * "=" against an integer or string constant qualifies.
+ */
+PRIVATE bool
+scan_casekey(struct when_list *walk, enum VAL_TYPE *type, long *key,
+             struct string **skey)
+{
+    struct expression *exp = walk->exp;
+    int             neg = 0;
+
+    if (walk->op != eqlSYM)
+        return false;
+
+    if (exp->optype == T_EXP_IS_STRING) {
+        exp = exp->e.exp;
+
+        if (exp->optype != T_STRING)
+            return false;
+
+        *type = V_STRING;
+        *skey = exp->e.str;
+
+        return true;
+    }
+
+    if (exp->optype == T_EXP_IS_NUM)
+        exp = exp->e.exp;
+
+    if (exp->optype == T_UNARY && exp->op == minusSYM) {
+        neg = 1;
+        exp = exp->e.exp;
+    }
+
+    if (exp->optype != T_INTNUM || exp->e.num > MAX_EXACT_INT)
+        return false;
+
+    *type = V_INT;
+    *key = neg ? -exp->e.num : exp->e.num;
+
+    return true;
+}
+
+
+/*
+ * Build the jump table of a CASE statement whose WHENs only compare
+ * against constants of one type. Integer keys that lie close together
+ * get a directly indexed table, all others a hash table. Keys that
+ * occur more than once keep their first WHEN, just like the sequential
+ * search in exec_case() would.
+ */
+PRIVATE void
+scan_case(struct comal_line *line)
+{
+    struct comal_line *whenline;
+    struct when_list *walk;
+    struct case_table *table;
+    struct case_entry *entry;
+    struct case_entry **bucket;
+    struct string  *skey = NULL;
+    enum VAL_TYPE   type = V_ERROR;
+    enum VAL_TYPE   ktype;
+    long            key = 0;
+    long            low = 0;
+    long            high = 0;
+    long            nkeys = 0;
+    long            i;
+
+    free_casetable(line->lc.caserec.table);
+    line->lc.caserec.table = NULL;
+
+    for (whenline = line->lineptr; whenline->cmd == whenSYM;
+         whenline = whenline->lineptr)
+        for (walk = whenline->lc.whenroot; walk; walk = walk->next) {
+            if (!scan_casekey(walk, &ktype, &key, &skey))
+                return;
+
+            if (type == V_ERROR)
+                type = ktype;
+            else if (type != ktype)
+                return;
+
+            if (ktype == V_INT) {
+                if (!nkeys || key < low)
+                    low = key;
+                if (!nkeys || key > high)
+                    high = key;
+            }
+
+            nkeys++;
+        }
+
+    if (!nkeys)
+        return;
+
+    table = (struct case_table *) mem_alloc_private(curenv->program_pool,
+                                                    sizeof(struct
+                                                           case_table));
+    table->type = type;
+    table->low = low;
+    table->dense = (type == V_INT
+                    && (unsigned long) high - (unsigned long) low <
+                    (unsigned long) (2 * nkeys + 8));
+
+    if (table->dense) {
+        table->size = high - low + 1;
+        table->slot =
+            (struct comal_line **) mem_alloc_private(curenv->program_pool,
+                                                     table->size *
+                                                     sizeof(struct
+                                                            comal_line *));
+    } else {
+        table->size = 2 * nkeys + 1;
+        table->bucket =
+            (struct case_entry **) mem_alloc_private(curenv->program_pool,
+                                                     table->size *
+                                                     sizeof(struct
+                                                            case_entry *));
+    }
+
+    for (whenline = line->lineptr; whenline->cmd == whenSYM;
+         whenline = whenline->lineptr)
+        for (walk = whenline->lc.whenroot; walk; walk = walk->next) {
+            scan_casekey(walk, &ktype, &key, &skey);
+
+            if (table->dense) {
+                if (!table->slot[key - low])
+                    table->slot[key - low] = whenline;
+
+                continue;
+            }
+
+            if (type == V_INT)
+                i = (unsigned long) key % table->size;
+            else
+                i = str_hash(skey->s) % table->size;
+
+            for (bucket = &table->bucket[i]; *bucket;
+                 bucket = &(*bucket)->next)
+                if (type == V_INT ? (*bucket)->key == key
+                    : str_cmp((*bucket)->skey, skey) == 0)
+                    break;
+
+            if (*bucket)
+                continue;
+
+            entry =
+                (struct case_entry *) mem_alloc_private(curenv->program_pool,
+                                                        sizeof(struct
+                                                               case_entry));
+            entry->key = key;
+            entry->skey = skey;
+            entry->whenline = whenline;
+            *bucket = entry;
+        }
+
+    if (whenline->cmd == otherwiseSYM)
+        table->otherwise = whenline;
+
+    line->lc.caserec.table = table;
+}
+
+
+/*
+ * Pick the shortcut exec_assign() may take for each assignment of a
+ * line: a numeric variable or array element that is assigned to, or a
+ * simple numeric variable that is incremented/decremented
+ */
+PRIVATE void
+scan_assign(struct comal_line *line)
+{
+    struct assign_list *work;
+
+    for (work = line->lc.assignroot; work; work = work->next)
+        if (work->lval->optype != T_ID)
+            work->kind = A_GENERAL;
+        else if (work->op == becomesSYM)
+            work->kind = A_NUM;
+        else if (!work->lval->e.expid.exproot)
+            work->kind = A_INCR;
+        else
+            work->kind = A_GENERAL;
+}
+
+
 /*
  * SCAN pass 2
  *
@@ -224,6 +472,7 @@ scan_pass4(struct seg_des *seg, char *errtxt, struct comal_line **errline)
     struct comal_line *curline;
     struct comal_line *theline;
     struct comal_line *procline = NULL;
+    struct comal_line *trapend = NULL;
     struct comal_line *walkline;
     struct comal_line *walk;
     struct parm_list *pwalk;
@@ -246,6 +495,16 @@ scan_pass4(struct seg_des *seg, char *errtxt, struct comal_line **errline)
         if (!theline)
             theline = curline;
 
+        /*
+         * No tail calls between a TRAP and its HANDLER: reusing the frame
+         * would leave exec_trap() and so drop the HANDLER
+         */
+        if (theline == trapend)
+            trapend = NULL;
+        else if (!trapend && theline->cmd == trapSYM
+                 && !theline->lc.traprec.esc)
+            trapend = theline->lineptr;
+
         if (theline->cmd == procSYM || theline->cmd == funcSYM
             || theline->cmd == moduleSYM) {
             scan_stack_push(0, procline);
@@ -283,8 +542,13 @@ scan_pass4(struct seg_des *seg, char *errtxt, struct comal_line **errline)
             } else if (theline->lc.exp)
                 err =
                     "This statement (inside a PROC or MODULE) must not RETURN an expression";
+
+            theline->lineptr =
+                trapend ? NULL : scan_tailcall(curline, theline, procline);
         } else if (theline->cmd == execSYM) {
             proccall = &theline->lc.exp->e.expid;
+            theline->lineptr =
+                trapend ? NULL : scan_tailcall(curline, theline, procline);
 
             if (!routine_search(proccall->id, procSYM, procline)) {
                 procfound = 0;
@@ -317,7 +581,11 @@ scan_pass4(struct seg_des *seg, char *errtxt, struct comal_line **errline)
                     return false;
                 }
             }
-        } else if (theline->cmd == restoreSYM) {
+        } else if (theline->cmd == caseSYM)
+            scan_case(theline);
+        else if (theline->cmd == becomesSYM)
+            scan_assign(theline);
+        else if (theline->cmd == restoreSYM) {
             if (seg) {
                 walk = curenv->progroot;
 
@@ -543,29 +811,21 @@ do_special1(struct scan_entry *p, struct comal_line *theline,
 }
 
 
-PUBLIC bool
-scan_scan(struct seg_des *seg, char *errtxt, struct comal_line **errline)
+/*
+ * Link the control structures of the lines from curline on. If last is
+ * not NULL, the scan stops at that line, which must be the one that
+ * empties the scan stack.
+ */
+PRIVATE bool
+scan_lines(struct comal_line *curline, struct comal_line *last,
+           struct seg_des *seg, int *level, struct comal_line **procroot,
+           char *errtxt, struct comal_line **errline)
 {
-    struct comal_line *curline;
     struct comal_line *theline;
     struct comal_line *lineptr;
     struct scan_entry *p;
     int             sym;
     int             cmd2;
-    struct comal_line *procroot = NULL;
-    int             level;
-
-    if (seg) {
-        curline = seg->lineroot;
-        level = seg->extdef->lc.pfrec.level;
-    } else {
-        curline = curenv->progroot;
-        level = 0;
-    }
-
-    scan_sp = 0;
-    *errline = NULL;
-    *errtxt = 0;
 
     while (curline) {
         int             skip_processing;
@@ -608,8 +868,8 @@ scan_scan(struct seg_des *seg, char *errtxt, struct comal_line **errline)
             }
 
             if (!do_special1
-                (p, theline, curline, errline, errtxt, &level,
-                 &procroot, seg))
+                (p, theline, curline, errline, errtxt, level,
+                 procroot, seg))
                 return false;
 
             if (!skip_processing) {
@@ -641,9 +901,38 @@ scan_scan(struct seg_des *seg, char *errtxt, struct comal_line **errline)
             }
         }
 
+        if (last && (scan_sp == 0 || curline == last))
+            return scan_sp == 0 && curline == last;
+
         curline = curline->ld->next;
     }
 
+    return !last;
+}
+
+
+PUBLIC bool
+scan_scan(struct seg_des *seg, char *errtxt, struct comal_line **errline)
+{
+    struct comal_line *curline;
+    struct comal_line *procroot = NULL;
+    int             level;
+
+    if (seg) {
+        curline = seg->lineroot;
+        level = seg->extdef->lc.pfrec.level;
+    } else {
+        curline = curenv->progroot;
+        level = 0;
+    }
+
+    scan_sp = 0;
+    *errline = NULL;
+    *errtxt = 0;
+
+    if (!scan_lines(curline, NULL, seg, &level, &procroot, errtxt, errline))
+        return false;
+
     if (scan_sp) {
         Fmt_sfmt(errtxt, MAX_LINELEN,
                  "%d open control structure%s at EOP\n", scan_sp,
@@ -673,6 +962,59 @@ scan_scan(struct seg_des *seg, char *errtxt, struct comal_line **errline)
 }
 
 
+/*
+ * Link the control structures inside the PROC, FUNC or MODULE proc
+ * again, when all edits since the last SCAN were between its first and
+ * last line. Its links with the rest of the program are still right.
+ */
+PRIVATE bool
+scan_proc(struct comal_line *proc, char *errtxt,
+          struct comal_line **errline)
+{
+    struct comal_line *procroot = NULL;
+    struct scan_entry *p;
+    int             level = proc->lc.pfrec.level + 1;
+
+    for (p = scan_tab; p->sym != proc->cmd; p++);
+
+    scan_sp = 0;
+    *errline = NULL;
+    *errtxt = 0;
+    scan_stack_push(p->leavessym, proc);
+
+    return scan_lines(proc->ld->next, proc->lineptr, NULL, &level,
+                      &procroot, errtxt, errline);
+}
+
+
+PUBLIC bool
+scan_update(char *errtxt, struct comal_line **errline)
+{
+    struct comal_line *proc = curenv->dirtyproc;
+    struct comal_line *walk;
+
+    curenv->dirtyproc = NULL;
+
+    if (!curenv->datalptr) {
+        for (walk = curenv->progroot; walk && walk->cmd != dataSYM;
+             walk = walk->ld->next);
+
+        curenv->datalptr = walk;
+        curenv->dataeptr = walk ? walk->lc.exproot : NULL;
+    }
+
+    if (!curenv->scan_ok && !(proc && scan_proc(proc, errtxt, errline)))
+        return scan_scan(NULL, errtxt, errline);
+
+    *errtxt = 0;
+
+    if (!scan_pass2(NULL, errtxt, errline))
+        return false;
+
+    return scan_pass4(NULL, errtxt, errline);
+}
+
+
 /*
  * The prog_structure_scan is "only" used to get the indentation right...
  */
@@ -682,48 +1024,100 @@ INDENT(int x)
     return (x >= INDENTION * MAX_INDENT ? INDENTION * MAX_INDENT : x);
 }
 
+/*
+ * Find the scan_tab entry of a line that changes the indentation, or
+ * NULL if the line does not
+ */
+PRIVATE struct scan_entry *
+structure_entry(struct comal_line *line)
+{
+    struct scan_entry *p;
+    int             cmd2 = line_2cmd(line);
+
+    for (p = scan_tab; p->sym && p->sym != line->cmd; p++);
+
+    if (!p->sym || (p->special == SHORT_FORM && cmd2) ||
+        (p->special == PROCFUNC && line->lc.pfrec.external)
+        || (line->cmd == trapSYM && line->lc.traprec.esc))
+        return NULL;            /* Prevent indention */
+
+    return p;
+}
+
+
+PRIVATE void
+structure_indent(struct comal_line *line, int *indent)
+{
+    struct scan_entry *p = structure_entry(line);
+
+    if (p && (p->expectsym1 || p->expectsym2)) {
+        *indent -= INDENTION;
+
+        if (*indent < 0)
+            *indent = 0;
+    }
+
+    line->ld->indent = INDENT(*indent);
+
+    if (p && p->leavessym)
+        *indent += INDENTION;
+}
+
+
 PUBLIC void
 prog_structure_scan(void)
 {
     int             indent = 0;
-    struct comal_line *curline = curenv->progroot;
-    struct scan_entry *p;
+    struct comal_line *curline;
 
     DBG_PRINTF(true, "Structure scanning...");
 
-    while (curline) {
-        int             skip_processing;
-        int             cmd2;
+    for (curline = curenv->progroot; curline; curline = curline->ld->next)
+        structure_indent(curline, &indent);
+}
 
-        cmd2 = line_2cmd(curline);
-        skip_processing = 0;
 
-        curline->ld->indent = INDENT(indent);
+/*
+ * Redo the indentation after the line prev (or from the start if prev
+ * is NULL) was changed, stopping at the first line after that whose
+ * indentation shows that the rest of the program is still right
+ */
+PUBLIC void
+prog_structure_rescan(struct comal_line *prev)
+{
+    int             indent = 0;
+    int             old;
+    struct comal_line *curline;
+    struct scan_entry *p;
 
-        for (p = scan_tab; p->sym && p->sym != curline->cmd; p++);
+    if (prev) {
+        if (prev->ld->indent >= INDENTION * MAX_INDENT) {
+            prog_structure_scan();
+            return;
+        }
 
-        if (p->sym) {
-            if ((p->special == SHORT_FORM && cmd2) ||
-                (p->special == PROCFUNC && curline->lc.pfrec.external)
-                || (curline->cmd == trapSYM && curline->lc.traprec.esc))
-                skip_processing = 1;    /* Prevent indention */
+        p = structure_entry(prev);
+        indent = prev->ld->indent + (p && p->leavessym ? INDENTION : 0);
+        curline = prev->ld->next;
+    } else
+        curline = curenv->progroot;
 
-            if (!skip_processing) {
-                if (p->expectsym1 || p->expectsym2) {
-                    indent -= INDENTION;
+    if (!curline)
+        return;
 
-                    if (indent < 0)
-                        indent = 0;
+    structure_indent(curline, &indent);
 
-                    curline->ld->indent = INDENT(indent);
-                }
+    for (curline = curline->ld->next; curline; curline = curline->ld->next) {
+        old = curline->ld->indent;
+        p = structure_entry(curline);
 
-                if (p->leavessym)
-                    indent += INDENTION;
-            }
-        }
+        if (p && (p->expectsym1 || p->expectsym2))
+            old = old ? old + INDENTION : -1;
 
-        curline = curline->ld->next;
+        if (old == indent && old < INDENTION * MAX_INDENT)
+            return;
+
+        structure_indent(curline, &indent);
     }
 }
 
@@ -736,8 +1130,6 @@ scan_necessary(struct comal_line *line)
 
     for (i = 0; scan_tab[i].sym; i++)
         if (scan_tab[i].sym == line->cmd || scan_tab[i].sym == cmd2) {
-            curenv->scan_ok = false;
-
             if (scan_tab[i].leavessym)
                 if (line_2cmd(line) != 0
                     ||
@@ -758,10 +1150,44 @@ scan_necessary(struct comal_line *line)
 }
 
 
+/*
+ * Record that line is changed. If all changes since the last SCAN are
+ * inside one PROC, FUNC or MODULE of the main program, only that one
+ * has to be SCANned again.
+ */
+PRIVATE void
+scan_dirty(struct comal_line *line)
+{
+    long            lineno = line->ld->lineno;
+    struct comal_line *proc = NULL;
+
+    if (curenv->scan_ok || curenv->dirtyproc)
+        for (proc = curenv->globalproc; proc; proc = proc->lc.pfrec.proclink)
+            if (!proc->lc.pfrec.external && proc->lineptr
+                && proc->ld->lineno < lineno
+                && lineno < proc->lineptr->ld->lineno)
+                break;
+
+    if (!curenv->scan_ok && proc != curenv->dirtyproc)
+        proc = NULL;
+
+    curenv->dirtyproc = proc;
+    curenv->scan_ok = false;
+}
+
+
 PUBLIC bool
 assess_scan(struct comal_line *line)
 {
     const char     *msg = NULL;
+    struct scan_entry *p;
+    int             cmd2 = line_2cmd(line);
+
+    for (p = scan_tab; p->sym; p++)
+        if (p->sym == line->cmd || p->sym == cmd2) {
+            scan_dirty(line);
+            break;
+        }
 
     if (entering)
         return false;
@@ -780,7 +1206,7 @@ assess_scan(struct comal_line *line)
                     "a program structure line");
     }
     if (msg) {
-        curenv->scan_ok = false;
+        scan_dirty(line);
 
         if (curenv->running == HALTED && !curenv->con_inhibited) {
             my_printf(MSG_DIALOG, true,
@@ -19,9 +19,15 @@
 extern bool     scan_scan(struct seg_des *seg, char *errtxt,
                           struct comal_line **errline);
 
+/** SCAN the current program again, as far as it changed since the last SCAN */
+extern bool     scan_update(char *errtxt, struct comal_line **errline);
+
 /** Partial SCAN to get the indentation right */
 extern void     prog_structure_scan(void);
 
+/** Get the indentation right again after the line following @c prev changed */
+extern void     prog_structure_rescan(struct comal_line *prev);
+
 /** Tests if the line @c line contains a structure command, which forces a SCAN if changed */
 extern int      scan_necessary(struct comal_line *line);
 
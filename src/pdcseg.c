@@ -22,8 +22,19 @@
 #include "pdcexec.h"
 #include "pdcexp.h"
 #include "pdcprog.h"
+#include "pdcstr.h"
+#include "pdcsym.h"
 #include "pdcseg.h"
 
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef __APPLE__
+#define ST_MTIME_NSEC(st)	((st)->st_mtimensec)
+#else
+#define ST_MTIME_NSEC(st)	((st)->st_mtim.tv_nsec)
+#endif
+
 PUBLIC void
 seg_total_scan(struct seg_des *seg)
 {
@@ -89,6 +100,25 @@ seg_proccheck(struct comal_line *mline, struct comal_line
 }
 
 
+PRIVATE struct seg_des *
+seg_load(struct comal_line *line, char *fname)
+{
+    struct seg_des *seg;
+
+    seg = (struct seg_des *) mem_alloc(RUN_POOL, sizeof(struct seg_des));
+    seg->lineroot = expand_fromfile(fname, NULL);
+    seg->extdef = line;
+    seg->save_localproc = line->lc.pfrec.localproc;
+    seg_total_scan(seg);
+    seg_proccheck(line, seg->procdef);
+    seg->prev = NULL;
+    seg->next = NULL;
+    seg->filename = NULL;
+
+    return seg;
+}
+
+
 PUBLIC struct seg_des *
 seg_static_load(struct comal_line *line)
 {
@@ -98,14 +128,8 @@ seg_static_load(struct comal_line *line)
     struct seg_des *seg;
 
     calc_exp(pf->external->filename, (void **) &name, &type);
-    seg = (struct seg_des *) mem_alloc(RUN_POOL, sizeof(struct seg_des));
-    seg->lineroot = expand_fromfile(name->s);
+    seg = seg_load(line, name->s);
     mem_free(name);
-    seg->extdef = line;
-    seg->save_localproc = line->lc.pfrec.localproc;
-    seg_total_scan(seg);
-    seg_proccheck(line, seg->procdef);
-    seg->prev = NULL;
 
     pf->external->seg = seg;
 
@@ -113,12 +137,108 @@ seg_static_load(struct comal_line *line)
 }
 
 
+/*
+ * Dynamic segments are not freed after the call, but kept in a cache
+ * (curenv->segcache) until the end of the run. The next call of the
+ * same EXTERNAL PROC/FUNC takes the segment from the cache again, if
+ * its file is still the same one (device and inode) with the same size
+ * and modification time, to the nanosecond. A segment is only
+ * in the cache while no call is using it; a recursive call loads a
+ * copy of its own. The least recently used segments are freed to keep
+ * the size of their files below SEG_CACHE_SIZE.
+ */
+PRIVATE struct seg_des *
+seg_cache_take(struct comal_line *line, char *fname, struct stat *st)
+{
+    struct seg_des **walk;
+    struct seg_des *seg;
+
+    for (walk = &curenv->segcache; *walk; walk = &(*walk)->next) {
+        seg = *walk;
+
+        if (seg->extdef == line && seg->dev == st->st_dev
+            && seg->ino == st->st_ino
+            && seg->mtime == (long) st->st_mtime
+            && seg->mtime_nsec == (long) ST_MTIME_NSEC(st)
+            && seg->size == (long) st->st_size
+            && strcmp(seg->filename, fname) == 0) {
+            *walk = seg->next;
+            seg->next = NULL;
+            curenv->segcache_size -= seg->size;
+
+            return seg;
+        }
+    }
+
+    return NULL;
+}
+
+
+PRIVATE void
+seg_cache_evict(long max)
+{
+    struct seg_des **walk;
+    struct seg_des *seg;
+
+    while (curenv->segcache && curenv->segcache_size >= max) {
+        for (walk = &curenv->segcache; (*walk)->next;
+             walk = &(*walk)->next);
+
+        seg = *walk;
+        *walk = NULL;
+        curenv->segcache_size -= seg->size;
+        seg_static_free(seg);
+    }
+}
+
+
+/*
+ * Put a segment that is no longer in use in the cache, in the state a
+ * fresh load would leave it in: STATIC variables are gone
+ */
+PRIVATE void
+seg_cache_put(struct seg_des *seg)
+{
+    struct comal_line *walk;
+
+    FOR_EACH_LINE(seg, walk)
+        if ((walk->cmd == procSYM || walk->cmd == funcSYM
+             || walk->cmd == moduleSYM) && walk->lc.pfrec.staticenv) {
+            sym_freeenv(walk->lc.pfrec.staticenv, 0);
+            walk->lc.pfrec.staticenv = NULL;
+        }
+
+    seg->extdef->lc.pfrec.localproc = seg->save_localproc;
+    seg_cache_evict(SEG_CACHE_SIZE - seg->size);
+    seg->next = curenv->segcache;
+    curenv->segcache = seg;
+    curenv->segcache_size += seg->size;
+}
+
+
 PUBLIC struct seg_des *
 seg_dynamic_load(struct comal_line *line)
 {
-    struct seg_des *seg = seg_static_load(line);
+    struct string  *name;
+    enum VAL_TYPE   type;
+    struct seg_des *seg = NULL;
+    struct stat     st;
+
+    calc_exp(line->lc.pfrec.external->filename, (void **) &name, &type);
+
+    if (stat(name->s, &st) < 0)
+        seg = seg_load(line, name->s);
+    else if (!(seg = seg_cache_take(line, name->s, &st))) {
+        seg = seg_load(line, name->s);
+        seg->filename = my_strdup(RUN_POOL, name->s);
+        seg->dev = st.st_dev;
+        seg->ino = st.st_ino;
+        seg->mtime = (long) st.st_mtime;
+        seg->mtime_nsec = (long) ST_MTIME_NSEC(&st);
+        seg->size = (long) st.st_size;
+    }
 
-    line->lc.pfrec.external->seg = NULL;
+    mem_free(name);
     seg->prev = curenv->segroot;
     curenv->segroot = seg;
 
@@ -130,6 +250,7 @@ seg_static_free(struct seg_des *seg)
 {
     prog_del(&seg->lineroot, 0, INT_MAX, 0);
     seg->extdef->lc.pfrec.localproc = seg->save_localproc;
+    mem_free(seg->filename);
 
     return (struct seg_des *) mem_free(seg);
 }
@@ -140,7 +261,38 @@ seg_dynamic_free(struct seg_des *seg)
 {
     IP(curenv->segroot == seg, "Internal seg_free() error #1");
 
-    return curenv->segroot = seg_static_free(seg);
+    curenv->segroot = seg->prev;
+
+    if (seg->filename && seg->size < SEG_CACHE_SIZE)
+        seg_cache_put(seg);
+    else
+        seg_static_free(seg);
+
+    return curenv->segroot;
+}
+
+
+PUBLIC void
+seg_forget(struct comal_line *line)
+{
+    struct seg_des **walk = &curenv->segcache;
+    struct seg_des *seg;
+
+    /*
+     * Freeing a segment may drop other segments from the cache, so
+     * start again from the front after each one
+     */
+    while (*walk) {
+        seg = *walk;
+
+        if (seg->extdef == line) {
+            *walk = seg->next;
+            curenv->segcache_size -= seg->size;
+            seg_static_free(seg);
+            walk = &curenv->segcache;
+        } else
+            walk = &seg->next;
+    }
 }
 
 
@@ -154,6 +306,7 @@ seg_allfree(void)
         walk = seg_dynamic_free(walk);
 
     curenv->segroot = NULL;
+    seg_cache_evict(0);
 
     while (curline) {
         if ((curline->cmd == procSYM || curline->cmd == funcSYM
@@ -30,6 +30,9 @@ extern struct seg_des *seg_static_free(struct seg_des *seg);
 /** Free resources associated with a dynamic external segment */
 extern struct seg_des *seg_dynamic_free(struct seg_des *seg);
 
+/** Drop the cached dynamic segments of an EXTERNAL PROC/FUNC line */
+extern void     seg_forget(struct comal_line *line);
+
 /** Free all external segments */
 extern void     seg_allfree(void);
 
@@ -21,6 +21,9 @@
 #include "pdcsqash.h"
 #include "pdcexec.h"
 #include <string.h>
+#include <limits.h>
+#include <stdint.h>
+#include <sys/stat.h>
 
 PRIVATE void    sqash_exp(struct expression *exp);
 PRIVATE void    sqash_horse(struct comal_line *line);
@@ -34,11 +37,43 @@ PRIVATE unsigned sqash_hwm;
 PRIVATE unsigned sqash_i;
 PRIVATE FILE   *sqash_file;
 
+/*
+ * Table of pointers, numbered in the order they were added. At SAVE a
+ * hash (slot, holding index + 1) finds the number of a pointer.
+ */
+struct sqash_table {
+    void          **item;
+    long           *slot;
+    long            nr;
+    long            max;
+};
+
+/*
+ * The identifiers of a file are written once, in a table in its header,
+ * and referred to by their index in that table. At SAVE a first pass
+ * over the program without a file fills the table.
+ */
+PRIVATE struct sqash_table sqash_ids;
+
+/*
+ * The lines of a file, numbered for the structure links of an image
+ */
+PRIVATE struct sqash_table sqash_lines;
+
+/*
+ * Numbers are written as LEB128 varints of their zigzag encoding and
+ * doubles as 8 little endian bytes, so that a file can be loaded on any
+ * host. Files older than SQ_VERSION hold native longs, ints and doubles.
+ */
+PRIVATE bool    sqash_portable;
+
 
 PRIVATE void
 sqash_flush(void)
 {
-    if (sqash_i > 0) {
+    if (!sqash_file) {
+        sqash_i = 0;            /* First pass, output not wanted */
+    } else if (sqash_i > 0) {
         if (fwrite(sqash_buf, 1, sqash_i, sqash_file) <= 0) {
             fclose(sqash_file);
             run_error(SQASH_ERR,
@@ -77,20 +112,30 @@ sqash_putc(char c)
 PRIVATE void
 sqash_putlong(char code, long l)
 {
+    unsigned long   u = (unsigned long) l << 1;
+    unsigned char   buf[(sizeof(long) * CHAR_BIT + 6) / 7];
+    unsigned        n = 0;
+
     if (code)
         sqash_putc(code);
 
-    sqash_put(&l, sizeof(long));
+    if (l < 0)
+        u = ~u;
+
+    while (u >= 0x80) {
+        buf[n++] = (unsigned char) ((u & 0x7f) | 0x80);
+        u >>= 7;
+    }
+
+    buf[n++] = (unsigned char) u;
+    sqash_put(buf, n);
 }
 
 
 PRIVATE void
 sqash_putint(char code, int i)
 {
-    if (code)
-        sqash_putc(code);
-
-    sqash_put(&i, sizeof(int));
+    sqash_putlong(code, i);
 }
 
 
@@ -121,22 +166,110 @@ sqash_putstr2(int code, const char *s)
 PRIVATE void
 sqash_putdouble(char code, struct dubbel *d)
 {
+    uint64_t        u;
+    unsigned char   buf[8];
+    int             i;
+
     if (code)
         sqash_putc(code);
 
-    sqash_put(&d->val, sizeof(double));
+    memcpy(&u, &d->val, sizeof(u));
+
+    for (i = 0; i < 8; i++)
+        buf[i] = (unsigned char) (u >> (8 * i));
+
+    sqash_put(buf, 8);
     sqash_putstr2(SQ_DOUBLE, d->text);
 }
 
 
+PRIVATE long   *
+table_find(struct sqash_table *t, void *p)
+{
+    unsigned long   mask = 2 * t->max - 1;
+    unsigned long   h = ((uintptr_t) p >> 3) * 2654435761UL;
+    long           *slot;
+
+    while (true) {
+        slot = &t->slot[h & mask];
+
+        if (*slot == 0 || t->item[*slot - 1] == p)
+            return slot;
+
+        h++;
+    }
+}
+
 
 PRIVATE void
-sqash_putid(struct id_rec *id)
+table_grow(struct sqash_table *t, long max, bool hashed)
 {
-    if (id)
-        sqash_putstr2(SQ_ID, id->name);
+    long            i;
+
+    t->max = max;
+
+    if (t->item)
+        t->item = (void **) mem_realloc(t->item, max * sizeof(void *));
     else
-        sqash_putstr2(SQ_ID, NULL);
+        t->item = (void **) mem_alloc(MISC_POOL, max * sizeof(void *));
+
+    if (!hashed)
+        return;
+
+    mem_free(t->slot);
+    t->slot = (long *) mem_alloc(MISC_POOL, 2 * max * sizeof(long));
+
+    for (i = 0; i < t->nr; i++)
+        *table_find(t, t->item[i]) = i + 1;
+}
+
+
+/*
+ * Return the index of p, adding it if it is new
+ */
+PRIVATE long
+table_add(struct sqash_table *t, void *p)
+{
+    long           *slot = table_find(t, p);
+
+    if (*slot == 0) {
+        if (t->nr == t->max) {
+            table_grow(t, 2 * t->max, true);
+            slot = table_find(t, p);
+        }
+
+        t->item[t->nr++] = p;
+        *slot = t->nr;
+    }
+
+    return *slot - 1;
+}
+
+
+PRIVATE void
+table_free(struct sqash_table *t)
+{
+    mem_free(t->item);
+    mem_free(t->slot);
+    t->item = NULL;
+    t->slot = NULL;
+    t->nr = 0;
+    t->max = 0;
+}
+
+
+PRIVATE void
+sqash_putid(struct id_rec *id)
+{
+    if (!id) {
+        sqash_putc(SQ_EMPTYSTRING);
+        return;
+    }
+
+    IP(!sqash_file || *table_find(&sqash_ids, id) != 0,
+       "Id missing from the id table");
+
+    sqash_putint(SQ_IDREF, table_add(&sqash_ids, id));
 }
 
 
@@ -190,7 +323,13 @@ sqash_exp(struct expression *exp)
         return;
     }
 
-    sqash_putint(SQ_EXP, exp->optype);
+    if (exp->optype == T_FOLDED)
+        exp = exp->e.folded.exp;
+
+    if (exp->optype == T_BINARY_I || exp->optype == T_BINARY_F)
+        sqash_putint(SQ_EXP, T_BINARY);
+    else
+        sqash_putint(SQ_EXP, exp->optype);
 
     switch (exp->optype) {
     case T_CONST:
@@ -231,6 +370,8 @@ sqash_exp(struct expression *exp)
         break;
 
     case T_BINARY:
+    case T_BINARY_I:
+    case T_BINARY_F:
         sqash_putint(0, exp->op);
         sqash_twoexp(&exp->e.twoexp);
         break;
@@ -478,8 +619,11 @@ sqash_horse(struct comal_line *line)
         sqash_idlist(line->lc.idroot);
         break;
 
-    case execSYM:
     case caseSYM:
+        sqash_exp(line->lc.caserec.exp);
+        break;
+
+    case execSYM:
     case runSYM:
     case delSYM:
     case chdirSYM:
@@ -598,37 +742,110 @@ sqash_horse(struct comal_line *line)
 }
 
 
+PRIVATE bool
+is_routine(struct comal_line *line)
+{
+    return line->cmd == procSYM || line->cmd == funcSYM
+        || line->cmd == moduleSYM;
+}
+
+
+PRIVATE void
+sqash_putline(struct comal_line *line)
+{
+    sqash_putlong(0, line ? *table_find(&sqash_lines, line) : 0);
+}
+
+
+/*
+ * Write the links that scan_scan() made between the lines, so that the
+ * file is an image that can be run without scanning its structure again.
+ * The lines are numbered in program order, each followed by the
+ * statement of its short form, if any.
+ */
+PRIVATE void
+sqash_putlinks(void)
+{
+    struct comal_line *work;
+    struct comal_line *stat;
+    long            i;
+
+    table_grow(&sqash_lines, 256, true);
+
+    for (work = curenv->progroot; work; work = work->ld->next) {
+        table_add(&sqash_lines, work);
+
+        if ((stat = line_2line(work)) != NULL)
+            table_add(&sqash_lines, stat);
+    }
+
+    sqash_putlong(SQ_SCAN, sqash_lines.nr);
+
+    for (i = 0; i < sqash_lines.nr; i++) {
+        work = (struct comal_line *) sqash_lines.item[i];
+        sqash_putline(work->lineptr);
+
+        if (is_routine(work)) {
+            sqash_putint(0, work->lc.pfrec.level);
+            sqash_putline(work->lc.pfrec.proclink);
+            sqash_putline(work->lc.pfrec.localproc);
+            sqash_putline(work->lc.pfrec.fatherproc);
+        }
+    }
+
+    sqash_putline(curenv->globalproc);
+    table_free(&sqash_lines);
+}
+
+
 PUBLIC void
 sqash_2file(char *fname)
 {
-    struct comal_line *work = curenv->progroot;
+    struct comal_line *work;
     const char     *s;
+    long            i;
 
-    sqash_file = fopen(fname, "wb");
+    table_free(&sqash_ids);
+    table_grow(&sqash_ids, 256, true);
+    sqash_buf = (char *) mem_alloc(MISC_POOL, SQASH_BUFSIZE);
+    sqash_file = NULL;
+    sqash_i = 0;
 
-    if (sqash_file == NULL)
-        run_error(OPEN_ERR, "File open error: %s", strerror(errno));
+    for (work = curenv->progroot; work; work = work->ld->next)
+        sqash_horse(work);
 
-    sqash_buf = (char *) mem_alloc(MISC_POOL, SQASH_BUFSIZE);
     sqash_i = 0;
+    sqash_file = fopen(fname, "wb");
+
+    if (sqash_file == NULL) {
+        mem_free(sqash_buf);
+        table_free(&sqash_ids);
+        run_error(OPEN_ERR, "File open error: %s", strerror(errno));
+    }
 
     for (s = SQ_MARKER; *s; s++)
         sqash_putc(*s);
 
-    sqash_putc(HOST_OS_CODE);
-    sqash_putstr2(SQ_CONTROL, HOST_OS);
+    sqash_putc(SQ_PORTABLE);
     sqash_putint(0, SQ_VERSION);
     sqash_putstr2(SQ_CONTROL, SQ_COPYRIGHT_MSG);
 
-    while (work) {
+    sqash_putlong(SQ_IDTABLE, sqash_ids.nr);
+
+    for (i = 0; i < sqash_ids.nr; i++)
+        sqash_putstr2(SQ_ID, ((struct id_rec *) sqash_ids.item[i])->name);
+
+    for (work = curenv->progroot; work; work = work->ld->next)
         sqash_horse(work);
-        work = work->ld->next;
-    }
+
+    if (curenv->scan_ok)
+        sqash_putlinks();
 
     sqash_putstr2(SQ_CONTROL, SQ_COPYRIGHT_MSG);
     sqash_flush();
 
     mem_free(sqash_buf);
+    table_free(&sqash_ids);
 
     if (fclose(sqash_file) == EOF)
         run_error(CLOSE_ERR, "Error closing file: %s", strerror(errno));
@@ -641,60 +858,74 @@ sqash_2file(char *fname)
  */
 /***************/
 
+/*
+ * The whole file is read into sqash_buf in one go, after which the
+ * fields are taken straight out of the buffer.
+ */
 PRIVATE void
 expand_read(void)
 {
-    int             status;
+    struct stat     st;
+    unsigned        size = SQASH_BUFSIZE;
+    size_t          got;
+
+    if (fstat(fileno(sqash_file), &st) == 0 && S_ISREG(st.st_mode))
+        size = st.st_size + 1;  /* + 1 to see the end of file at once */
+
+    sqash_buf = (char *) mem_alloc(MISC_POOL, size);
+    sqash_hwm = 0;
+    sqash_i = 0;
 
-    status = fread(sqash_buf, 1, SQASH_BUFSIZE, sqash_file);
+    while ((got = fread(sqash_buf + sqash_hwm, 1, size - sqash_hwm,
+                        sqash_file)) > 0) {
+        sqash_hwm += got;
 
-    if (status < 0) {
+        if (sqash_hwm == size) {
+            size *= 2;
+            sqash_buf = (char *) mem_realloc(sqash_buf, size);
+        }
+    }
+
+    if (ferror(sqash_file)) {
         fclose(sqash_file);
         run_error(SQASH_ERR, "Error when reading from file: %s",
                   strerror(errno));
     }
+}
 
-    sqash_hwm = status;
-    sqash_i = 0;
+
+PRIVATE void
+expand_need(unsigned size)
+{
+    if (size > sqash_hwm - sqash_i)
+        run_error(SQASH_ERR, "SAVE file is truncated");
 }
 
 
 PRIVATE char
 expand_getc(void)
 {
-    char            c;
-
-    if (sqash_i >= sqash_hwm)
-        expand_read();
-
-    c = *(sqash_buf + sqash_i);
-    sqash_i++;
+    expand_need(1);
 
-    return c;
+    return sqash_buf[sqash_i++];
 }
 
 
 PRIVATE void
 expand_get(void *data, unsigned size)
 {
-    unsigned        i;
-
-    for (i = 0; i < size; i++)
-        *((char *) data + i) = expand_getc();
+    expand_need(size);
+    memcpy(data, sqash_buf + sqash_i, size);
+    sqash_i += size;
 }
 
 
 PRIVATE char
 expand_peekc(void)
 {
-    char            c;
-
-    if (sqash_i >= sqash_hwm)
-        expand_read();
-
-    c = *(sqash_buf + sqash_i);
+    expand_need(1);
 
-    return c;
+    return sqash_buf[sqash_i];
 }
 
 
@@ -709,11 +940,30 @@ expand_check(char c)
 PRIVATE long
 expand_getlong(void)
 {
+    unsigned long   u = 0;
+    unsigned        shift = 0;
+    unsigned char   b;
     long            l;
 
-    expand_get(&l, sizeof(long));
+    if (!sqash_portable) {
+        expand_get(&l, sizeof(long));
 
-    return l;
+        return l;
+    }
+
+    do {
+        b = (unsigned char) expand_getc();
+
+        if (shift >= sizeof(long) * CHAR_BIT
+            || ((unsigned long) (b & 0x7f) << shift) >> shift !=
+            (unsigned long) (b & 0x7f))
+            run_error(SQASH_ERR, "SAVE file number too large for this host");
+
+        u |= (unsigned long) (b & 0x7f) << shift;
+        shift += 7;
+    } while (b & 0x80);
+
+    return (u & 1) ? ~(long) (u >> 1) : (long) (u >> 1);
 }
 
 
@@ -721,10 +971,20 @@ PRIVATE int
 expand_getint(void)
 {
     int             i;
+    long            l;
+
+    if (!sqash_portable) {
+        expand_get(&i, sizeof(int));
+
+        return i;
+    }
+
+    l = expand_getlong();
 
-    expand_get(&i, sizeof(int));
+    if (l < INT_MIN || l > INT_MAX)
+        run_error(SQASH_ERR, "SAVE file number too large for this host");
 
-    return i;
+    return (int) l;
 }
 
 
@@ -738,6 +998,11 @@ expand_getstr(int code)
         long            l;
 
         l = expand_getlong();
+
+        if (l < 0)
+            run_error(SQASH_ERR, "SAVE file is corrupt");
+
+        expand_need(l);
         s = STR_ALLOC_PRIVATE(curenv->program_pool, l);
         expand_get(s->s, l);
         s->len = l;
@@ -758,6 +1023,11 @@ expand_getstr2(int code)
         int             i;
 
         i = expand_getint();
+
+        if (i < 0)
+            run_error(SQASH_ERR, "SAVE file is corrupt");
+
+        expand_need(i + 1);
         s = (char *) mem_alloc_private(curenv->program_pool, i + 1);
         expand_get(s, i + 1);
     } else
@@ -770,25 +1040,178 @@ expand_getstr2(int code)
 PRIVATE void
 expand_getdouble(struct dubbel *d)
 {
-    expand_get(&d->val, sizeof(double));
+    unsigned char   buf[8];
+    uint64_t        u = 0;
+    int             i;
+
+    if (sqash_portable) {
+        expand_get(buf, 8);
+
+        for (i = 7; i >= 0; i--)
+            u = (u << 8) | buf[i];
+
+        memcpy(&d->val, &u, sizeof(double));
+    } else {
+        expand_get(&d->val, sizeof(double));
+    }
+
     d->text = expand_getstr2(SQ_DOUBLE);
 }
 
 
 
+/*
+ * Look the identifier up right from the buffer, where it is stored
+ * with its '\0'
+ */
+PRIVATE struct id_rec *
+expand_getname(void)
+{
+    char           *s;
+    int             i = expand_getint();
+
+    if (i < 0)
+        run_error(SQASH_ERR, "SAVE file is corrupt");
+
+    expand_need(i + 1);
+    s = sqash_buf + sqash_i;
+    sqash_i += i + 1;
+
+    if (s[i] != '\0')
+        run_error(SQASH_ERR, "SAVE file is corrupt");
+
+    return id_search(s);
+}
+
+
 PRIVATE struct id_rec *
 expand_getid(void)
 {
-    struct id_rec  *id;
-    char           *s = expand_getstr2(SQ_ID);
+    char            c = expand_getc();
+    int             i;
 
-    if (s) {
-        id = id_search(s);
-        mem_free(s);
-    } else
-        id = NULL;
+    if (c == SQ_IDREF) {
+        i = expand_getint();
+
+        if (i < 0 || i >= sqash_ids.nr)
+            run_error(SQASH_ERR, "SAVE file is corrupt");
+
+        return (struct id_rec *) sqash_ids.item[i];
+    } else if (c == SQ_ID) {
+        return expand_getname();        /* SQ_VERSION_IDNAMES */
+    }
 
-    return id;
+    IP(c == SQ_EMPTYSTRING, "Internal sqash/expand error #1");
+
+    return NULL;
+}
+
+
+/*
+ * Read the id table from the header, interning every id once
+ */
+PRIVATE void
+expand_idtable(void)
+{
+    long            n;
+
+    expand_check(SQ_IDTABLE);
+    n = expand_getlong();
+
+    if (n < 0 || n > (long) (sqash_hwm - sqash_i))
+        run_error(SQASH_ERR, "SAVE file is corrupt");
+
+    table_grow(&sqash_ids, n + 1, false);
+
+    for (sqash_ids.nr = 0; sqash_ids.nr < n; sqash_ids.nr++) {
+        expand_check(SQ_ID);
+        sqash_ids.item[sqash_ids.nr] = expand_getname();
+    }
+}
+
+
+PRIVATE struct comal_line *
+expand_getline(void)
+{
+    long            i = expand_getlong();
+
+    if (i < 0 || i > sqash_lines.nr)
+        run_error(SQASH_ERR, "SAVE file is corrupt");
+
+    return i ? (struct comal_line *) sqash_lines.item[i - 1] : NULL;
+}
+
+
+/*
+ * Read the links of an image (see sqash_putlinks()) and, if links is
+ * not NULL, put them in place
+ */
+PRIVATE void
+expand_getlinks(struct comal_line *root, struct sqash_links *links)
+{
+    struct comal_line *work;
+    struct comal_line *stat;
+    struct comal_line *lineptr;
+    struct comal_line *globalproc;
+    struct proc_func_rec pf;
+    long            n;
+    long            i;
+
+    expand_check(SQ_SCAN);
+    n = expand_getlong();
+
+    if (n < 0 || n > (long) (sqash_hwm - sqash_i))
+        run_error(SQASH_ERR, "SAVE file is corrupt");
+
+    table_grow(&sqash_lines, n + 1, false);
+
+    for (work = root; work; work = work->ld->next) {
+        if (sqash_lines.nr >= n)
+            run_error(SQASH_ERR, "SAVE file is corrupt");
+
+        sqash_lines.item[sqash_lines.nr++] = work;
+
+        if ((stat = line_2line(work)) != NULL) {
+            if (sqash_lines.nr >= n)
+                run_error(SQASH_ERR, "SAVE file is corrupt");
+
+            sqash_lines.item[sqash_lines.nr++] = stat;
+        }
+    }
+
+    if (sqash_lines.nr != n)
+        run_error(SQASH_ERR, "SAVE file is corrupt");
+
+    for (i = 0; i < n; i++) {
+        work = (struct comal_line *) sqash_lines.item[i];
+        lineptr = expand_getline();
+
+        if (links)
+            work->lineptr = lineptr;
+
+        if (is_routine(work)) {
+            pf.level = expand_getint();
+            pf.proclink = expand_getline();
+            pf.localproc = expand_getline();
+            pf.fatherproc = expand_getline();
+
+            if (links) {
+                work->lc.pfrec.level = pf.level;
+                work->lc.pfrec.proclink = pf.proclink;
+                work->lc.pfrec.localproc = pf.localproc;
+                work->lc.pfrec.fatherproc = pf.fatherproc;
+            }
+        }
+    }
+
+    globalproc = expand_getline();
+
+    if (links) {
+        links->linked = true;
+        links->globalproc = globalproc;
+    }
+
+    table_free(&sqash_lines);
 }
 
 
@@ -969,6 +1392,15 @@ expand_exp(void)
 
     exp->optype = o;
 
+    if (exp_foldable(exp)) {
+        struct expression *folded = exp;
+
+        EXP_ALLOC(struct exp_folded);
+        exp->optype = T_FOLDED;
+        exp->e.folded.exp = folded;
+    } else
+        exp_typed(exp);
+
     DBG_PRINTF(true, "Exp expanded");
 
     return exp;
@@ -991,7 +1423,7 @@ expand_dim(struct comal_line *line)
     struct dim_ension *droot;
     struct dim_ension *dwork;
 
-    while (expand_peekc() == SQ_ID) {
+    while (expand_peekc() == SQ_IDREF || expand_peekc() == SQ_ID) {
         work =
             (struct dim_list *) mem_alloc_private(curenv->program_pool,
                                                   sizeof(struct dim_list));
@@ -1295,8 +1727,11 @@ expand_horse(void)
         line->lc.idroot = expand_idlist();
         break;
 
-    case execSYM:
     case caseSYM:
+        line->lc.caserec.exp = expand_exp();
+        break;
+
+    case execSYM:
     case runSYM:
     case delSYM:
     case chdirSYM:
@@ -1428,12 +1863,13 @@ expand_horse(void)
 
 
 PUBLIC struct comal_line *
-expand_fromfile(char *fname)
+expand_fromfile(char *fname, struct sqash_links *links)
 {
     struct comal_line *root = NULL;
     struct comal_line *line;
     struct comal_line *last = NULL;
     char           *checkstr;
+    int             version;
     const char     *s;
     extern bool     eof(int file);
 
@@ -1442,28 +1878,47 @@ expand_fromfile(char *fname)
     if (sqash_file == NULL)
         run_error(OPEN_ERR, "File open error: %s", strerror(errno));
 
-    sqash_buf = (char *) mem_alloc(MISC_POOL, SQASH_BUFSIZE);
-    sqash_i = MAXUNSIGNED;
+    expand_read();
+
+    if (fclose(sqash_file) == EOF)
+        run_error(CLOSE_ERR, "Error closing file: %s", strerror(errno));
 
     for (s = SQ_MARKER; *s; s++)
         if (expand_getc() != *s)
             run_error(SQASH_ERR, "Not an OpenComal SAVE file");
 
-    if (expand_getc() != HOST_OS_CODE)
-        run_error(SQASH_ERR,
-                  "File not an OpenComal file saved under this OS");
+    /*
+     * Portable files go without the name of the OS they were saved on
+     */
+    sqash_portable = ((unsigned char) expand_peekc() == SQ_PORTABLE);
 
-    checkstr = expand_getstr2(SQ_CONTROL);
+    if (sqash_portable) {
+        expand_getc();
+        version = expand_getint();
 
-    if (strcmp(checkstr, HOST_OS) != 0)
-        run_error(SQASH_ERR,
-                  "File not an OpenComal file saved under this OS");
+        if (version != SQ_VERSION)
+            run_error(SQASH_ERR,
+                      "File has been saved under a different version of the Sqasher");
+    } else {
+        if (expand_getc() != HOST_OS_CODE)
+            run_error(SQASH_ERR,
+                      "File not an OpenComal file saved under this OS");
 
-    mem_free(checkstr);
+        checkstr = expand_getstr2(SQ_CONTROL);
+
+        if (strcmp(checkstr, HOST_OS) != 0)
+            run_error(SQASH_ERR,
+                      "File not an OpenComal file saved under this OS");
+
+        mem_free(checkstr);
 
-    if (expand_getint() != SQ_VERSION)
-        run_error(SQASH_ERR,
-                  "File has been saved under a different version of the Sqasher");
+        version = expand_getint();
+
+        if (version != SQ_VERSION_IDTABLE
+            && version != SQ_VERSION_IDNAMES)
+            run_error(SQASH_ERR,
+                      "File has been saved under a different version of the Sqasher");
+    }
 
     checkstr = expand_getstr2(SQ_CONTROL);
 
@@ -1471,6 +1926,13 @@ expand_fromfile(char *fname)
         fatal("Internal sqash/expand error #6");
 
     mem_free(checkstr);
+    table_free(&sqash_ids);
+
+    if (links)
+        links->linked = false;
+
+    if (version != SQ_VERSION_IDNAMES)
+        expand_idtable();
 
     while (expand_peekc() == SQ_LINE) {
         line = expand_horse();
@@ -1483,19 +1945,20 @@ expand_fromfile(char *fname)
         last = line;
     }
 
+    if (expand_peekc() == SQ_SCAN)
+        expand_getlinks(root, links);
+
     checkstr = expand_getstr2(SQ_CONTROL);
 
     if (strcmp(checkstr, SQ_COPYRIGHT_MSG) != 0)
         fatal("Internal sqash/expand error #7");
 
-    if (!feof(sqash_file) || sqash_i < sqash_hwm)
+    if (sqash_i < sqash_hwm)
         fatal("Internal sqash/expand error #8");
 
     mem_free(checkstr);
     mem_free(sqash_buf);
-
-    if (fclose(sqash_file) == EOF)
-        run_error(CLOSE_ERR, "Error closing file: %s", strerror(errno));
+    table_free(&sqash_ids);
 
     return root;
 }
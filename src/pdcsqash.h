@@ -16,7 +16,10 @@
 #define PDCSQASH_H
 
 #define SQ_COPYRIGHT_MSG	"OpenComal/Sqash (c) 1992-2002 Muppet Lab"
-#define SQ_VERSION		0x1254
+#define SQ_VERSION		0x1256
+#define SQ_VERSION_IDTABLE	0x1255  /**< Older, native ints and doubles */
+#define SQ_VERSION_IDNAMES	0x1254  /**< Older, with names for ids */
+#define SQ_PORTABLE		0x80    /**< In place of HOST_OS_CODE */
 #define SQ_MARKER		"SqAsH"
 
 /*
@@ -47,11 +50,15 @@
 #define SQ_TWOEXP		21
 #define SQ_IDLIST		22
 #define SQ_ENDIDLIST		23
+#define SQ_IDTABLE		24      /**< Header table of all ids */
+#define SQ_IDREF		25      /**< Id, by index in SQ_IDTABLE */
+#define SQ_SCAN			26      /**< Structure links of an image */
 
 /** Tokenize & save the current program to a file */
 extern void     sqash_2file(char *fname);
 
-/** Load & detokenize a file, overwriting the current program */
-extern struct comal_line *expand_fromfile(char *fname);
+/** Load & detokenize a file; links (if not NULL) get its structure links */
+extern struct comal_line *expand_fromfile(char *fname,
+                                          struct sqash_links *links);
 
 #endif
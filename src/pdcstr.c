@@ -17,6 +17,7 @@
 #include <string.h>
 #include "pdcglob.h"
 #include "pdcstr.h"
+#include "mem.h"
 
 
 PUBLIC char    *
@@ -41,6 +42,34 @@ str_cmp(struct string *s1, struct string *s2)
 }
 
 
+/*
+ * Hash a string such that strings which str_cmp() finds equal get the
+ * same hash value, by hashing the strxfrm()ed form of it
+ */
+PUBLIC unsigned long
+str_hash(const char *s)
+{
+    char            small[256];
+    char           *buf = small;
+    size_t          n = strxfrm_l(NULL, s, 0, latin_loc);
+    unsigned long   h = 2166136261UL;
+    size_t          i;
+
+    if (n >= sizeof(small))
+        buf = (char *) mem_alloc(MISC_POOL, n + 1);
+
+    strxfrm_l(buf, s, n + 1, latin_loc);
+
+    for (i = 0; i < n; i++)
+        h = (h ^ (unsigned char) buf[i]) * 16777619UL;
+
+    if (buf != small)
+        mem_free(buf);
+
+    return h;
+}
+
+
 PUBLIC struct string *
 str_make(int pool, const char *s)
 {
@@ -192,19 +221,61 @@ str_extend(int pool, struct string **s, long newlen)
     *s = work;
 }
 
+/*
+ * Latin-9 and UTF-8 only differ above 0x7f. Check a word at a time
+ * whether any byte has its top bit set.
+ */
+PUBLIC bool
+str_isascii(const char *s, size_t len)
+{
+    const unsigned long high = ~0UL / 0xff * 0x80;
+    unsigned long   acc = 0;
+    unsigned long   w;
+    size_t          i;
+
+    for (i = 0; i + sizeof(w) <= len; i += sizeof(w)) {
+        memcpy(&w, s + i, sizeof(w));
+        acc |= w;
+    }
+
+    for (; i < len; i++)
+        acc |= (unsigned char) s[i];
+
+    return (acc & high) == 0;
+}
+
+
+/*
+ * Returns lstr itself if it is plain ASCII, else a conversion in a buffer
+ * that is reused by the next call
+ */
 PUBLIC char    *
 str_ltou(const char *lstr)
 {
-    static char     ustr[OCOMAL_PATH_MAX];
+    static char    *ustr = NULL;
+    static size_t   usize = 0;
     const char     *inbuf;
     char           *outbuf;
     size_t          inbytesleft,
                     outbytesleft;
 
-    inbuf = lstr;
     inbytesleft = strlen(lstr);
+
+    if (str_isascii(lstr, inbytesleft))
+        return (char *) lstr;
+
+    /*
+     * A Latin-9 character takes at most 3 bytes in UTF-8 
+     */
+    if (usize < 3 * inbytesleft + 1) {
+        usize = 3 * inbytesleft + 1;
+        FREE(ustr);
+        ustr = ALLOC(usize);
+    }
+
+    inbuf = lstr;
     outbuf = ustr;
-    outbytesleft = OCOMAL_PATH_MAX;
+    outbytesleft = usize - 1;
     iconv(latin_to_utf8, (char **) &inbuf, &inbytesleft, &outbuf,
           &outbytesleft);
     *outbuf = '\0';
@@ -23,6 +23,9 @@ extern char    *my_strdup(int pool, const char *s);
 /** Compare two COMAL strings */
 extern int      str_cmp(struct string *s1, struct string *s2);
 
+/** Hash a string, consistent with str_cmp() */
+extern unsigned long str_hash(const char *s);
+
 /** Convert a C string to a COMAL string */
 extern struct string *str_make(int pool, const char *s);
 
@@ -57,6 +60,9 @@ extern struct string *str_maxdup(int pool, struct string *s, long n);
 /** Extend the storage allocated for a COMAL string */
 extern void     str_extend(int pool, struct string **s, long newlen);
 
+/** Check whether a string has only ASCII characters */
+extern bool     str_isascii(const char *s, size_t len);
+
 /** Convert a string from Latin-9 to UTF8 encoding */
 extern char    *str_ltou(const char *lstr);
 
@@ -25,7 +25,9 @@
 #include "msgnrs.h"
 
 #include <signal.h>
+#include <stdarg.h>
 #include <string.h>
+#include <poll.h>
 #define NCURSES_OPAQUE 1
 #include <curses.h>
 #include <time.h>
@@ -43,6 +45,7 @@
 #include "fmt.h"
 
 #define HALFDELAY 2
+#define HEADLESS_COLS 80        /**< Screen width without curses */
 
 #define CHECK(fn, ...) { \
         if ((fn)(__VA_ARGS__) == ERR) { \
@@ -55,6 +58,16 @@ PRIVATE volatile int escape = 0;
 PRIVATE int     paged = 0,
     pagern;
 PRIVATE bool    is_utf8_put = false;
+PRIVATE bool    put_pending = false;
+PRIVATE struct timespec last_refresh;
+PUBLIC bool     batch_output = true;
+PRIVATE bool    headless = false;
+PRIVATE bool    ansi = false;
+PRIVATE long    hl_row = 0,
+    hl_col = 0;
+PRIVATE char    hl_in[HEADLESS_BUFSIZE];
+PRIVATE long    hl_inpos = 0,
+    hl_inlen = 0;
 PRIVATE int     getx,
                 gety;
 PRIVATE char   *edit_line;
@@ -99,24 +112,30 @@ int_handler(int signum __my_unused)
     escape = 1;
 }
 
+/*
+ * Convert one UTF-8 character to Latin-9; '?' if it has no Latin-9
+ * equivalent
+ */
+PRIVATE char
+utf8_char_to_latin(char *uc, size_t l)
+{
+    char            lc = '?';
+    char           *outbuf = &lc;
+    size_t          outbytesleft = 1;
+
+    iconv(utf8_to_latin, &uc, &l, &outbuf, &outbytesleft);
+    iconv(utf8_to_latin, NULL, NULL, NULL, NULL);
+    return lc;
+}
+
 PRIVATE char
 wc_to_latin(wchar_t wc)
 {
-    char            uc[MB_LEN_MAX],
-                    lc;
+    char            uc[MB_LEN_MAX];
     int             l;
-    char           *inbuf,
-                   *outbuf;
-    size_t          inbytesleft,
-                    outbytesleft;
 
     l = wctomb(uc, wc);
-    inbuf = uc;
-    inbytesleft = l;
-    outbuf = &lc;
-    outbytesleft = 1;
-    iconv(utf8_to_latin, &inbuf, &inbytesleft, &outbuf, &outbytesleft);
-    return lc;
+    return l > 0 ? utf8_char_to_latin(uc, l) : '?';
 }
 
 PRIVATE int
@@ -215,21 +234,176 @@ curses_getc(FILE * in __my_unused)
 PRIVATE void
 addlstr(const char *lstr)
 {
+    static wchar_t *wstr = NULL;
+    static size_t   wsize = 0;
     char           *ustr;
-    wchar_t         wstr[MAX_LINELEN];
+    size_t          len;
 
     if (lstr == NULL) {
         return;
     }
+    len = strlen(lstr);
+    if (str_isascii(lstr, len)) {
+        CHECK(addnstr, lstr, len);
+        return;
+    }
     if (is_utf8_put) {
         ustr = (char *) lstr;
     } else {
         ustr = str_ltou(lstr);
     }
-    mbstowcs(wstr, ustr, MAX_LINELEN);
+    /*
+     * Never more wide characters than bytes 
+     */
+    if (wsize < len + 1) {
+        wsize = len + 1;
+        FREE(wstr);
+        wstr = ALLOC(wsize * sizeof(wchar_t));
+    }
+    mbstowcs(wstr, ustr, wsize);
     CHECK(addwstr, wstr);
 }
 
+/*
+ * Without curses (headless), output goes to stdout, and the cursor
+ * position is tracked here. CURSOR, PAGE etc. use ANSI sequences if
+ * stdout is a terminal, and do nothing otherwise.
+ */
+PRIVATE void
+hl_puts(const char *lstr)
+{
+    const char     *p;
+
+    if (lstr == NULL) {
+        return;
+    }
+    for (p = lstr; *p; p++) {
+        if (*p == '\n') {
+            hl_row++;
+            hl_col = 0;
+        } else if (*p == '\r') {
+            hl_col = 0;
+        } else {
+            hl_col++;
+        }
+    }
+    fputs(is_utf8_put ? lstr : str_ltou(lstr), stdout);
+}
+
+PRIVATE void
+hl_ansi(const char *fmt, ...)
+{
+    va_list         ap;
+
+    if (ansi) {
+        va_start(ap, fmt);
+        vfprintf(stdout, fmt, ap);
+        va_end(ap);
+    }
+}
+
+/*
+ * Headless input is read from stdin with read(2) into hl_in, never
+ * through stdio, so that sys_key() knows about every byte that is
+ * waiting: the ones in hl_in and the ones poll(2) reports.
+ *
+ * Make sure hl_in holds a byte, waiting at most msec milliseconds
+ * (-1 is forever). Returns 1 if it does, 0 on a timeout or a signal
+ * (ESC) and -1 at the end of the input.
+ */
+PRIVATE int
+hl_fill(long msec)
+{
+    struct pollfd   pfd = { STDIN_FILENO, POLLIN, 0 };
+    ssize_t         got;
+
+    if (hl_inpos < hl_inlen) {
+        return 1;
+    }
+    if (poll(&pfd, 1, msec) <= 0) {
+        return 0;
+    }
+    got = read(STDIN_FILENO, hl_in, sizeof(hl_in));
+    if (got < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+    hl_inpos = 0;
+    hl_inlen = got;
+    return got > 0 ? 1 : -1;
+}
+
+/*
+ * Take one character from the input, converted from UTF-8 to Latin-9.
+ * hl_fill() must have found a byte.
+ */
+PRIVATE char
+hl_getkey(void)
+{
+    char            uc[4];
+    unsigned char   c = hl_in[hl_inpos++];
+    size_t          l = 1,
+                    n;
+
+    if (c < 0x80) {
+        return c;
+    }
+    n = c >= 0xf0 ? 4 : c >= 0xe0 ? 3 : c >= 0xc0 ? 2 : 1;
+    uc[0] = c;
+
+    /*
+     * The rest of a character comes right after its first byte
+     */
+    while (l < n && hl_fill(HALFDELAY * 100) > 0
+           && (hl_in[hl_inpos] & 0xc0) == 0x80) {
+        uc[l++] = hl_in[hl_inpos++];
+    }
+    return utf8_char_to_latin(uc, l);
+}
+
+/*
+ * Read a line from stdin into line, converted to Latin-9
+ */
+PRIVATE bool
+hl_gets(char *line, int maxlen)
+{
+    char            uline[MAX_LINELEN * 4];
+    char           *inbuf = uline,
+        *outbuf = line;
+    size_t          inbytesleft,
+                    outbytesleft = maxlen - 1;
+    long            len = 0;
+    int             status;
+    char           *nl;
+
+    while (len < (long) sizeof(uline) - 1) {
+        while ((status = hl_fill(-1)) == 0);
+        if (status < 0) {
+            break;
+        }
+        nl = memchr(hl_in + hl_inpos, '\n', hl_inlen - hl_inpos);
+        inbytesleft = (nl ? nl + 1 - hl_in : hl_inlen) - hl_inpos;
+        if (inbytesleft > sizeof(uline) - 1 - len) {
+            inbytesleft = sizeof(uline) - 1 - len;
+        }
+        memcpy(uline + len, hl_in + hl_inpos, inbytesleft);
+        hl_inpos += inbytesleft;
+        len += inbytesleft;
+        if (uline[len - 1] == '\n') {
+            break;
+        }
+    }
+    if (len == 0) {
+        return false;
+    }
+    uline[len] = '\0';
+    remove_trailing(uline, "\n", "");
+    remove_trailing(uline, "\r", "");
+    inbytesleft = strlen(uline);
+    iconv(utf8_to_latin, &inbuf, &inbytesleft, &outbuf, &outbytesleft);
+    *outbuf = '\0';
+    return true;
+}
+
 PRIVATE void
 curses_redisplay(void)
 {
@@ -327,14 +501,26 @@ init_iconv(void)
 PRIVATE void
 screen_init(void)
 {
-    init_ncurses();
-    init_readline();
+    if (!headless && !isatty(STDOUT_FILENO)) {
+        headless = true;
+    }
+    if (headless) {
+        ansi = isatty(STDOUT_FILENO);
+        setvbuf(stdout, NULL, _IOFBF, HEADLESS_BUFSIZE);
+    } else {
+        init_ncurses();
+        init_readline();
+    }
     init_iconv();
 }
 
 PRIVATE void
 deinit_ncurses(void)
 {
+    if (headless) {
+        fflush(stdout);
+        return;
+    }
     CHECK(endwin);
     is_visual_mode = false;
 }
@@ -349,6 +535,7 @@ deinit_iconv(void)
 PRIVATE void
 screen_tini(void)
 {
+    sys_flush();
     deinit_ncurses();
     deinit_iconv();
 }
@@ -369,6 +556,13 @@ sys_init(void)
 }
 
 
+PUBLIC void
+sys_headless(void)
+{
+    headless = true;
+}
+
+
 PUBLIC void
 sys_tini(void)
 {
@@ -380,6 +574,10 @@ sys_system(char *cmd)
 {
     int             rc;
 
+    if (headless) {
+        fflush(stdout);
+        return system(str_ltou(cmd));
+    }
     CHECK(reset_shell_mode);
     CHECK(putp, exit_ca_mode);
     fflush(stdout);
@@ -424,9 +622,47 @@ sys_randomize(long seed)
 }
 
 
+/*
+ * With batch_output on, the screen is not refreshed after each sys_put()
+ * but at most every PUT_FLUSH_MSEC, checked in sys_escape() before each
+ * statement. Reading a key refreshes the screen anyway.
+ */
+PRIVATE bool
+flush_due(void)
+{
+    struct timespec now;
+
+    if (!batch_output)
+        return true;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - last_refresh.tv_sec) * 1000 +
+        (now.tv_nsec - last_refresh.tv_nsec) / 1000000 >= PUT_FLUSH_MSEC;
+}
+
+
+PUBLIC void
+sys_flush(void)
+{
+    if (put_pending) {
+        put_pending = false;
+        if (headless) {
+            fflush(stdout);
+        } else {
+            CHECK(refresh);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &last_refresh);
+    }
+}
+
+
 PUBLIC bool
 sys_escape(void)
 {
+    if (put_pending && flush_due())
+        sys_flush();
+
     if (escape) {
         escape = 0;
 
@@ -439,6 +675,14 @@ sys_escape(void)
 PRIVATE void
 do_put(int stream, const char *buf)
 {
+    if (headless) {
+        hl_puts(buf);
+        put_pending = true;
+        if (flush_due()) {
+            sys_flush();
+        }
+        return;
+    }
     if (stream == MSG_ERROR) {
         CHECK(standout);
     }
@@ -449,7 +693,10 @@ do_put(int stream, const char *buf)
         CHECK(standend);
     }
 
-    CHECK(refresh);
+    put_pending = true;
+
+    if (stream == MSG_ERROR || flush_due())
+        sys_flush();
 }
 
 PUBLIC void
@@ -464,6 +711,11 @@ sys_put(int stream, const char *buf, long len)
         return;
     }
 
+    if (headless) {
+        do_put(stream, buf);
+        return;
+    }
+
     buf_lines = len / COLS;
 
     if ((len % COLS) > 0)
@@ -501,7 +753,10 @@ sys_put(int stream, const char *buf, long len)
 PUBLIC void
 sys_page(FILE * f)
 {
-    if (f == NULL) {
+    if (f == NULL && headless) {
+        hl_ansi("\033[H\033[2J");
+        hl_row = hl_col = 0;
+    } else if (f == NULL) {
         CHECK(erase);
     } else {
         ext_page(f);
@@ -512,7 +767,9 @@ sys_page(FILE * f)
 PUBLIC void
 sys_clrtoeol(FILE * f)
 {
-    if (f == NULL) {
+    if (f == NULL && headless) {
+        hl_ansi("\033[K");
+    } else if (f == NULL) {
         CHECK(clrtoeol);
     }
 }
@@ -521,7 +778,9 @@ sys_clrtoeol(FILE * f)
 PUBLIC void
 sys_rvson(FILE * f)
 {
-    if (f == NULL) {
+    if (f == NULL && headless) {
+        hl_ansi("\033[7m");
+    } else if (f == NULL) {
         CHECK(attron, A_REVERSE);
     }
 }
@@ -530,7 +789,9 @@ sys_rvson(FILE * f)
 PUBLIC void
 sys_rvsoff(FILE * f)
 {
-    if (f == NULL) {
+    if (f == NULL && headless) {
+        hl_ansi("\033[27m");
+    } else if (f == NULL) {
         CHECK(attroff, A_REVERSE);
     }
 }
@@ -542,6 +803,18 @@ sys_cursor(FILE * f, long y, long x)
     if (f != NULL) {
         return;
     }
+    if (headless) {
+        if (y == 0) {
+            y = sys_currow();
+        }
+        if (x == 0) {
+            x = sys_curcol();
+        }
+        hl_ansi("\033[%ld;%ldH", y, x);
+        hl_row = y - 1;
+        hl_col = x - 1;
+        return;
+    }
     if (y > LINES || x > COLS) {
         run_error(CURSOR_ERR, "Coordinates off-screen");
     }
@@ -561,6 +834,9 @@ sys_curcol(void)
     int y           __my_unused;
     int             x;
 
+    if (headless) {
+        return hl_col + 1;
+    }
     getyx(stdscr, y, x);
     return x + 1;
 }
@@ -572,6 +848,9 @@ sys_currow(void)
     int             y;
     int x           __my_unused;
 
+    if (headless) {
+        return hl_row + 1;
+    }
     getyx(stdscr, y, x);
     return y + 1;
 }
@@ -580,7 +859,12 @@ sys_currow(void)
 PUBLIC void
 sys_nl(void)
 {
-    if (!ext_nl()) {
+    if (ext_nl()) {
+        return;
+    }
+    if (headless) {
+        hl_puts("\n");
+    } else {
         CHECK(addch, '\n');
     }
 }
@@ -589,7 +873,17 @@ sys_nl(void)
 PUBLIC void
 sys_ht(void)
 {
-    if (!ext_ht()) {
+    if (ext_ht()) {
+        return;
+    }
+    if (headless) {
+        /*
+         * Spaces up to the next zone, like curses with TABSIZE = zone 
+         */
+        do {
+            hl_puts(" ");
+        } while (hl_col % zone != 0);
+    } else {
         CHECK(addch, '\t');
     }
 }
@@ -606,7 +900,9 @@ PUBLIC void
 sys_zone(long size)
 {
 #ifdef NCURSES_VERSION
-    set_tabsize(size);
+    if (!headless) {
+        set_tabsize(size);
+    }
 #endif
     zone = size;
 }
@@ -617,6 +913,19 @@ sys_yn(int stream, const char *prompt)
 {
     do_put(stream, prompt);
 
+    if (headless) {
+        char            line[MAX_LINELEN];
+
+        sys_flush();
+        if (hl_gets(line, MAX_LINELEN)
+            && (line[0] == 'y' || line[0] == 'Y')) {
+            hl_puts(catgets(catdesc, UNIXSet, UNIXYes, "Yes\n"));
+            return true;
+        }
+        hl_puts(catgets(catdesc, UNIXSet, UNIXNo, "No\n"));
+        return false;
+    }
+
     for (;;) {
         char            c;
 
@@ -639,6 +948,38 @@ do_get(int stream, char *line, int maxlen, const char *prompt)
     bool            escape = false;
     char           *l;
 
+    if (headless) {
+        int             len = line ? strlen(line) : 0;
+
+        hl_puts(prompt);
+        hl_puts(line);
+        put_pending = true;
+        sys_flush();
+        if (!hl_gets(line + len, maxlen - len)) {
+            /*
+             * End of input: leave the interpreter, or stop the program 
+             */
+            if (stream == MSG_DIALOG) {
+                hl_puts("\n");
+                longjmp(RESTART, QUIT);
+            }
+            return true;
+        }
+        if (isatty(STDIN_FILENO)) {
+            /*
+             * The terminal echoed the line and the newline 
+             */
+            hl_row++;
+            hl_col = 0;
+        } else {
+            hl_puts(line + len);
+            if (stream != MSG_PROGRAM) {
+                hl_puts("\n");
+            }
+        }
+        return sys_escape();
+    }
+
     rl_num_chars_to_read = maxlen - 1;
     edit_line = line;
     addlstr(prompt);
@@ -754,7 +1095,7 @@ sys_tab_string(long col)
     if (col > curcol) {
         num_spaces = col - curcol;
     } else {
-        num_spaces = COLS - (curcol - col);
+        num_spaces = (headless ? HEADLESS_COLS : COLS) - (curcol - col);
     }
     memset(result, ' ', num_spaces);
     result[num_spaces] = '\0';
@@ -789,6 +1130,15 @@ sys_key(long delay)
     int             status = ERR;
     wint_t          c;
 
+    if (headless) {
+        sys_flush();
+        *result = '\0';
+        if (hl_fill(delay < 0 ? -1 : delay * 1000) > 0) {
+            *result = hl_getkey();
+        }
+        return result;
+    }
+
     /*
      * -1 means neverending delay 
      */
@@ -24,6 +24,20 @@
 
 #include "fmt.h"
 #include "pdcnana.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <locale.h>
+
+/*
+ * The powers of ten that are exact doubles 
+ */
+PRIVATE const double pow10tab[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#define MAX_POW10	22
 
 PRIVATE void
 val_print_array(int stream, struct var_item *var)
@@ -46,6 +60,250 @@ val_print_array(int stream, struct var_item *var)
     }
 }
 
+/*
+ * Like Fmt's "%D"
+ */
+PUBLIC int
+val_fmtint(char *buf, long num)
+{
+    char            tmp[24];
+    char           *p = tmp + sizeof(tmp);
+    unsigned long   m = num < 0 ? -(unsigned long) num : (unsigned long) num;
+    int             len;
+
+    do
+        *--p = m % 10 + '0';
+    while ((m /= 10) > 0);
+
+    if (num < 0)
+        *--p = '-';
+
+    len = tmp + sizeof(tmp) - p;
+    memcpy(buf, p, len);
+    buf[len] = '\0';
+
+    return len;
+}
+
+
+/*
+ * Scale a to 6 significant digits before the decimal point, given its
+ * decimal exponent e. Returns false when the scale factor is not an exact
+ * double.
+ */
+PRIVATE bool
+fmt_scale(double a, int e, double *s)
+{
+    int             k = 5 - e;
+
+    if (k > MAX_POW10 || k < -MAX_POW10)
+        return false;
+
+    *s = k >= 0 ? a * pow10tab[k] : a / pow10tab[-k];
+
+    return true;
+}
+
+
+/*
+ * Like Fmt's "%g" (or "%G" when upper), i.e. 6 significant digits. The
+ * 6 digits are found with one exactly rounded multiplication or division;
+ * when that leaves the result too close to a rounding tie to be sure,
+ * Fmt does the work.
+ */
+PUBLIC int
+val_fmtfloat(char *buf, double d, bool upper)
+{
+    char            digits[6];
+    char           *p = buf;
+    double          a = fabs(d);
+    double          s,
+                    fr;
+    long            m;
+    int             e,
+                    nd,
+                    i;
+
+    if (a == 0 && !signbit(d)) {
+        strcpy(buf, "0");
+        return 1;
+    }
+
+    if (!isfinite(d) || a == 0)
+        goto slow;
+
+    e = (int) floor(log10(a));
+
+    if (!fmt_scale(a, e, &s))
+        goto slow;
+
+    if (s >= 1000000.0) {
+        if (!fmt_scale(a, ++e, &s))
+            goto slow;
+    } else if (s < 100000.0) {
+        if (!fmt_scale(a, --e, &s))
+            goto slow;
+    }
+
+    fr = s - floor(s);
+
+    if (fabs(fr - 0.5) < 1e-6)
+        goto slow;
+
+    m = (long) floor(s) + (fr > 0.5);
+
+    if (m >= 1000000) {
+        m /= 10;
+        e++;
+    }
+
+    for (i = 5; i >= 0; i--, m /= 10)
+        digits[i] = m % 10 + '0';
+
+    for (nd = 6; nd > 1 && digits[nd - 1] == '0'; nd--);
+
+    if (d < 0)
+        *p++ = '-';
+
+    if (e < -4 || e >= 6) {
+        *p++ = digits[0];
+
+        if (nd > 1) {
+            *p++ = '.';
+            memcpy(p, digits + 1, nd - 1);
+            p += nd - 1;
+        }
+
+        *p++ = upper ? 'E' : 'e';
+        *p++ = e < 0 ? '-' : '+';
+
+        if (e < 0)
+            e = -e;
+
+        if (e >= 100)
+            *p++ = e / 100 + '0';
+
+        *p++ = e / 10 % 10 + '0';
+        *p++ = e % 10 + '0';
+    } else if (e >= 0) {
+        memcpy(p, digits, e + 1);
+        p += e + 1;
+
+        if (nd > e + 1) {
+            *p++ = '.';
+            memcpy(p, digits + e + 1, nd - e - 1);
+            p += nd - e - 1;
+        }
+    } else {
+        *p++ = '0';
+        *p++ = '.';
+
+        for (i = -1; i > e; i--)
+            *p++ = '0';
+
+        memcpy(p, digits, nd);
+        p += nd;
+    }
+
+    *p = '\0';
+
+    return p - buf;
+
+  slow:
+    Fmt_sfmt(buf, 64, upper ? "%G" : "%g", d);
+
+    return strlen(buf);
+}
+
+
+/*
+ * Like strtod(), but plain decimal numbers of up to 19 digits with a
+ * small exponent are converted here, exactly, by one multiplication or
+ * division. Anything else (hex, INF, NAN, a locale with another decimal
+ * point, many digits) goes to strtod().
+ */
+PUBLIC double
+val_strtod(const char *s, char **endptr)
+{
+    const char     *p = s;
+    uint64_t        mant = 0;
+    int             nd = 0,
+        dexp = 0,
+        exp = 0;
+    bool            neg = false,
+        any = false;
+    double          d;
+
+    if (*localeconv()->decimal_point != '.')
+        return strtod(s, endptr);
+
+    if (*p == '-' || *p == '+')
+        neg = (*p++ == '-');
+
+    if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+        return strtod(s, endptr);
+
+    for (; *p >= '0' && *p <= '9'; p++, any = true) {
+        if (mant || *p != '0') {
+            if (++nd > 19)
+                return strtod(s, endptr);
+
+            mant = mant * 10 + (*p - '0');
+        }
+    }
+
+    if (*p == '.') {
+        for (p++; *p >= '0' && *p <= '9'; p++, any = true) {
+            if (mant || *p != '0') {
+                if (++nd > 19)
+                    return strtod(s, endptr);
+
+                mant = mant * 10 + (*p - '0');
+            }
+
+            dexp--;
+        }
+    }
+
+    if (!any)
+        return strtod(s, endptr);
+
+    if (*p == 'e' || *p == 'E') {
+        const char     *q = p + 1;
+        bool            eneg = false;
+
+        if (*q == '-' || *q == '+')
+            eneg = (*q++ == '-');
+
+        if (*q >= '0' && *q <= '9') {
+            for (; *q >= '0' && *q <= '9'; q++)
+                if (exp < 10000)
+                    exp = exp * 10 + (*q - '0');
+
+            dexp += eneg ? -exp : exp;
+            p = q;
+        }
+    }
+
+    if (mant > ((uint64_t) 1 << 53))
+        return strtod(s, endptr);
+
+    if (mant == 0)
+        d = 0;
+    else if (dexp >= 0 && dexp <= MAX_POW10)
+        d = (double) mant * pow10tab[dexp];
+    else if (dexp < 0 && dexp >= -MAX_POW10)
+        d = (double) mant / pow10tab[-dexp];
+    else
+        return strtod(s, endptr);
+
+    if (endptr)
+        *endptr = (char *) p;
+
+    return neg ? -d : d;
+}
+
+
 PUBLIC void
 val_print(int stream, void *result, enum VAL_TYPE type)
 {
@@ -55,11 +313,11 @@ val_print(int stream, void *result, enum VAL_TYPE type)
 
     switch (type) {
     case V_INT:
-        Fmt_sfmt(buf, 64, "%D", *(long *) result);
+        len = val_fmtint(buf, *(long *) result);
         break;
 
     case V_FLOAT:
-        Fmt_sfmt(buf, 64, "%g", *(double *) result);
+        len = val_fmtfloat(buf, *(double *) result, false);
         break;
 
     case V_STRING:
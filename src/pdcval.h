@@ -15,6 +15,15 @@
 #ifndef PDCVAL_H
 #define PDCVAL_H
 
+/** Format an integer, returns its length */
+extern int      val_fmtint(char *buf, long num);
+
+/** Format a float like "%g" or "%G", returns its length */
+extern int      val_fmtfloat(char *buf, double d, bool upper);
+
+/** Convert a string to a float, like strtod() */
+extern double   val_strtod(const char *s, char **endptr);
+
 /** Print a value to the specified stream */
 extern void     val_print(int stream, void *result, enum VAL_TYPE type);
 